@@ -0,0 +1,131 @@
+/**
+ * Compares the structural scanners used by the CSV reader: the original
+ * per-field byte loop, CSVScanner::scanScalar and the vectorized
+ * CSVScanner::scan, on synthetic and TPC-H lineitem shaped data, or on a
+ * file given on the command line.
+ *
+ *   csv_scan_bench [file [delimiter]]
+ */
+
+#include <csv_scanner.h>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#define MB ((size_t) (1024 * 1024))
+#define WINDOW ((size_t) 64 * 1024)
+#define RUNS 5
+
+static std::string synthetic(size_t size) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int> len(0, 24);
+    std::string s;
+    s.reserve(size + 256);
+
+    while (s.size() < size) {
+        for (int j = 0; j < 8; ++j) {
+            if (j % 2 == 0) {
+                s += std::to_string(rng() % 100000000);
+            }
+            else {
+                s.append(len(rng), 'a' + (char) (rng() % 26));
+            }
+            s += j == 7 ? '\n' : ',';
+        }
+    }
+
+    return s;
+}
+
+static std::string lineitem(size_t size) {
+    static const char *modes[] = { "TRUCK", "MAIL", "REG AIR", "AIR", "FOB", "RAIL", "SHIP" };
+    static const char *instructions[] = { "DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN" };
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int> len(10, 43);
+    std::string s;
+    s.reserve(size + 256);
+    char buf[256];
+
+    for (size_t order = 1; s.size() < size; ++order) {
+        int n = snprintf(buf, sizeof(buf),
+            "%zu|%d|%d|%d|%d|%d.%02d|0.0%d|0.0%d|%c|%c|1996-%02d-%02d|1996-%02d-%02d|1996-%02d-%02d|%s|%s|",
+            order, (int) (rng() % 200000), (int) (rng() % 10000), (int) (rng() % 7 + 1),
+            (int) (rng() % 50 + 1), (int) (rng() % 100000), (int) (rng() % 100),
+            (int) (rng() % 10), (int) (rng() % 9), "NRA"[rng() % 3], "OF"[rng() % 2],
+            (int) (rng() % 12 + 1), (int) (rng() % 28 + 1),
+            (int) (rng() % 12 + 1), (int) (rng() % 28 + 1),
+            (int) (rng() % 12 + 1), (int) (rng() % 28 + 1),
+            instructions[rng() % 4], modes[rng() % 7]
+        );
+        s.append(buf, n);
+        s.append(len(rng), 'a' + (char) (rng() % 26));
+        s += "|\n";
+    }
+
+    return s;
+}
+
+// the byte loop CSVReader used before CSVScanner
+static size_t fieldLoop(const char *p, size_t len, char delimiter, uint32_t *offsets) {
+    const char *begin = p, *end = p + len;
+    size_t n = 0;
+    while (p != end) {
+        while (p != end && *p != delimiter && *p != '\n') ++p;
+        if (p == end) break;
+        offsets[n++] = p - begin;
+        ++p;
+    }
+    return n;
+}
+
+template <class Scan>
+static void run(const char *name, const std::string &data, char delimiter, Scan scan) {
+    std::vector<uint32_t> offsets(WINDOW);
+    double best = 0;
+    size_t count = 0;
+
+    for (int r = 0; r < RUNS; ++r) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        count = 0;
+        for (size_t i = 0; i < data.size(); i += WINDOW) {
+            size_t len = std::min(WINDOW, data.size() - i);
+            count += scan(data.data() + i, len, delimiter, offsets.data());
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        double gbs = data.size() / ((end - start).count() / 1e9) / 1e9;
+        if (gbs > best) best = gbs;
+    }
+
+    std::cout << "    " << name << ": " << best << " GB/s ("
+        << count << " structural characters)\n";
+}
+
+static void bench(const char *name, const std::string &data, char delimiter) {
+    std::cout << name << " (" << data.size() / MB << " MB)\n";
+    run("field loop ", data, delimiter, fieldLoop);
+    run("scan scalar", data, delimiter, CSVScanner::scanScalar);
+    run("scan simd  ", data, delimiter, CSVScanner::scan);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        std::ifstream f(argv[1], std::ios::binary);
+        std::stringstream s;
+        s << f.rdbuf();
+        bench(argv[1], s.str(), argc > 2 ? argv[2][0] : ',');
+        return 0;
+    }
+
+    bench("synthetic", synthetic(256 * MB), ',');
+    bench("lineitem", lineitem(256 * MB), '|');
+
+    return 0;
+}
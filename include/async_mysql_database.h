@@ -0,0 +1,131 @@
+#pragma once
+
+#include <mysql.h>
+#include <exception.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace spl;
+
+// only built against client libraries with the non-blocking API, see the
+// Makefile
+#ifdef HAVE_MYSQL_NONBLOCKING
+
+/**
+ * A set of MySQL connections driven by one thread. Queries go through the
+ * non-blocking client API (mysql_*_nonblocking, MySQL 8.0.16 and later):
+ * a call that would block returns early, and the connection waits on its
+ * socket in an epoll set until the server answers, so one thread keeps
+ * hundreds of connections busy at once instead of needing a thread each.
+ *
+ * Unlike MySQLDatabase, queries are not run one at a time by the caller;
+ * run() asks for the next query of a connection whenever it becomes idle and
+ * reports each one as it completes.
+ */
+class AsyncMySQLDatabase {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Returns the next query for the connection at the given index, or null
+     * if it has nothing more to run.
+     */
+    using NextQuery = std::function<const char * (size_t connection)>;
+
+    /**
+     * Called when a query completes on the connection at the given index,
+     * with the time it took and the error message if it failed, or null.
+     */
+    using QueryDone = std::function<void (size_t connection, uint64_t nanoseconds, const char *error)>;
+
+private:
+
+    enum class State {
+        CONNECTING,
+        IDLE,
+        QUERYING,
+        STORING,
+        FREEING,
+        RETIRED,
+    };
+
+    struct Connection {
+        MYSQL mysql;
+        State state = State::CONNECTING;
+        bool polled = false;
+
+        // the socket registered with the epoll set while polled
+        int fd = -1;
+        const char *sql = nullptr;
+        MYSQL_RES *result = nullptr;
+        Clock::time_point start;
+
+        // when the connection was last advanced, on an event or a retry
+        Clock::time_point progress;
+    };
+
+    const char *_host;
+    const char *_user;
+    const char *_password;
+    const char *_db;
+    unsigned int _port;
+
+    size_t _size;
+    std::unique_ptr<Connection[]> _connections;
+    int _epoll;
+
+    // number of connections with a call in progress
+    size_t _busy = 0;
+
+    const NextQuery *_next = nullptr;
+    const QueryDone *_done = nullptr;
+
+    void _poll(size_t index);
+
+    void _unpoll(size_t index);
+
+    void _wait(size_t timeout);
+
+    void _advance(size_t index);
+
+    void _complete(size_t index, const char *error);
+
+    void _startNext(size_t index);
+
+public:
+
+    /**
+     * Opens size connections at once, throwing if any of them fails.
+     */
+    AsyncMySQLDatabase(
+        const char *host,
+        const char *user,
+        const char *password,
+        const char *db,
+        unsigned int port,
+        size_t size
+    );
+
+    AsyncMySQLDatabase(const AsyncMySQLDatabase &) = delete;
+
+    ~AsyncMySQLDatabase();
+
+    AsyncMySQLDatabase & operator=(const AsyncMySQLDatabase &) = delete;
+
+    size_t size() const {
+        return _size;
+    }
+
+    /**
+     * Keeps every connection busy with the queries next hands out until it
+     * has none left for any of them, calling done for each completed query.
+     */
+    void run(const NextQuery &next, const QueryDone &done);
+};
+
+#endif
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+
+/**
+ * A fixed-capacity multi-producer multi-consumer queue connecting two stages
+ * of a pipeline. Slots carry a sequence number, so producers and consumers
+ * claim them with a single compare-and-swap and never take a lock. push()
+ * and pop() spin, then yield, then sleep while the queue is full or empty,
+ * which is how a slow stage pushes back on the stages feeding it.
+ *
+ * Each queue counts how often its producers found it full and its consumers
+ * found it empty, and samples its occupancy on every push, so the stage that
+ * is holding the pipeline back can be read off the counters after a run.
+ */
+template <typename T>
+class BoundedQueue {
+
+private:
+
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _mask;
+
+    alignas(64) std::atomic<size_t> _tail { 0 };
+    alignas(64) std::atomic<size_t> _head { 0 };
+    alignas(64) std::atomic<bool> _closed { false };
+
+    alignas(64) std::atomic<size_t> _pushes { 0 };
+    std::atomic<size_t> _pushStalls { 0 };
+    std::atomic<size_t> _popStalls { 0 };
+    std::atomic<size_t> _pushStallTime { 0 };
+    std::atomic<size_t> _popStallTime { 0 };
+    std::atomic<size_t> _occupancySum { 0 };
+    std::atomic<size_t> _maxOccupancy { 0 };
+
+    static void _backoff(size_t attempt) {
+        if (attempt < 64) return;
+        if (attempt < 128) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    static size_t _since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+    }
+
+    void _sample() {
+        size_t n = _tail.load(std::memory_order_relaxed)
+            - _head.load(std::memory_order_relaxed);
+        if ((ptrdiff_t) n < 0) n = 0;
+
+        _pushes.fetch_add(1, std::memory_order_relaxed);
+        _occupancySum.fetch_add(n, std::memory_order_relaxed);
+
+        size_t max = _maxOccupancy.load(std::memory_order_relaxed);
+        while (n > max && ! _maxOccupancy.compare_exchange_weak(
+            max, n, std::memory_order_relaxed
+        ));
+    }
+
+public:
+
+    /**
+     * Creates a queue holding at least capacity items; the capacity is
+     * rounded up to a power of two.
+     */
+    BoundedQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+
+        _slots = std::vector<Slot>(n);
+        _mask = n - 1;
+
+        for (size_t i = 0; i < n; ++i) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+
+    BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Appends value unless the queue is full.
+     */
+    bool tryPush(const T &value) {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto &slot = _slots[pos & _mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t) seq - (ptrdiff_t) pos;
+
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    _sample();
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Removes the oldest item into value unless the queue is empty.
+     */
+    bool tryPop(T &value) {
+        size_t pos = _head.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto &slot = _slots[pos & _mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t) seq - (ptrdiff_t) (pos + 1);
+
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = slot.value;
+                    slot.sequence.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Appends value, waiting while the queue is full.
+     */
+    void push(const T &value) {
+        if (tryPush(value)) return;
+
+        _pushStalls.fetch_add(1, std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t attempt = 0; ! tryPush(value); ++attempt) {
+            _backoff(attempt);
+        }
+
+        _pushStallTime.fetch_add(_since(start), std::memory_order_relaxed);
+    }
+
+    /**
+     * Removes the oldest item into value, waiting while the queue is empty.
+     * Returns false once the queue is closed and drained.
+     */
+    bool pop(T &value) {
+        if (tryPop(value)) return true;
+
+        _popStalls.fetch_add(1, std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t attempt = 0; ; ++attempt) {
+            // read closed before trying, so an item pushed right before
+            // close() is not missed
+            bool closed = _closed.load(std::memory_order_acquire);
+
+            if (tryPop(value)) break;
+
+            if (closed) {
+                _popStallTime.fetch_add(_since(start), std::memory_order_relaxed);
+                return false;
+            }
+
+            _backoff(attempt);
+        }
+
+        _popStallTime.fetch_add(_since(start), std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Marks the end of the input; consumers drain what is left and then see
+     * pop() return false.
+     */
+    void close() {
+        _closed.store(true, std::memory_order_release);
+    }
+
+    size_t capacity() const {
+        return _mask + 1;
+    }
+
+    size_t pushes() const {
+        return _pushes.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of pushes that found the queue full, i.e. times the consumers
+     * held the producers back.
+     */
+    size_t pushStalls() const {
+        return _pushStalls.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of pops that found the queue empty, i.e. times the consumers
+     * waited on the producers.
+     */
+    size_t popStalls() const {
+        return _popStalls.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Total time producers and consumers spent stalled, in seconds.
+     */
+    double pushStallTime() const {
+        return _pushStallTime.load(std::memory_order_relaxed) / 1e9;
+    }
+
+    double popStallTime() const {
+        return _popStallTime.load(std::memory_order_relaxed) / 1e9;
+    }
+
+    double averageOccupancy() const {
+        size_t n = pushes();
+        return n == 0 ? 0 : (double) _occupancySum.load(std::memory_order_relaxed) / n;
+    }
+
+    size_t maxOccupancy() const {
+        return _maxOccupancy.load(std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Conversions between proleptic Gregorian dates and days since 1970-01-01,
+ * after Howard Hinnant's days_from_civil and civil_from_days. Both take
+ * constant time and no locale or time zone, so generators can draw a day
+ * number and turn it into a date for a few nanoseconds.
+ */
+class Calendar {
+
+public:
+
+    static inline int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        int64_t era = (y >= 0 ? y : y - 399) / 400;
+        unsigned yoe = (unsigned) (y - era * 400);
+        unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (int64_t) doe - 719468;
+    }
+
+    static inline void civilFromDays(int64_t z, int &y, unsigned &m, unsigned &d) {
+        z += 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        unsigned doe = (unsigned) (z - era * 146097);
+        unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = (int) (yoe + era * 400 + (m <= 2));
+    }
+};
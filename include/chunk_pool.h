@@ -0,0 +1,97 @@
+#pragma once
+
+#include <csv.h>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/**
+ * A fixed set of reusable chunks of the same shape. Each chunk's columns are
+ * carved out of one arena that is allocated the first time it is needed and
+ * then recycled, so a long load does not keep going through malloc and
+ * faulting in fresh zeroed pages. acquire() blocks while every chunk is in
+ * use, which bounds the memory held by chunks in flight.
+ */
+class ChunkPool {
+
+private:
+
+    CSVOptions _options;
+    size_t _rows;
+    size_t _arenaSize;
+    size_t _capacity;
+    bool _hugePages;
+    size_t _waits = 0;
+
+    std::mutex _mtx;
+    std::condition_variable _available;
+    std::vector<ColumnarTableChunk *> _free;
+    std::vector<ColumnarTableChunk *> _all;
+
+    void * _allocateArena();
+
+public:
+
+    /**
+     * Creates a pool of at most capacity chunks of the given number of rows,
+     * optionally backed by huge pages.
+     */
+    ChunkPool(
+        const CSVOptions &options,
+        size_t rows,
+        size_t capacity,
+        bool hugePages = false
+    );
+
+    ChunkPool(const ChunkPool &) = delete;
+
+    ~ChunkPool();
+
+    ChunkPool & operator=(const ChunkPool &) = delete;
+
+    /**
+     * Returns a chunk with room for rows() rows, waiting for one to be
+     * released if the pool is exhausted.
+     */
+    ColumnarTableChunk * acquire();
+
+    void release(ColumnarTableChunk *chunk);
+
+    size_t rows() const {
+        return _rows;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t chunkMemorySize() const {
+        return _arenaSize;
+    }
+
+    size_t memorySize() const {
+        return _arenaSize * _capacity;
+    }
+
+    /**
+     * Number of calls to acquire() that had to wait for a chunk.
+     */
+    size_t waits() const {
+        return _waits;
+    }
+
+    /**
+     * Bytes needed to hold the columns of a chunk of the given number of rows.
+     */
+    static size_t arenaSize(const CSVOptions &options, size_t rows);
+
+    /**
+     * Lays the columns of a chunk of the given number of rows out in arena,
+     * which must hold at least arenaSize(options, rows) bytes.
+     */
+    static std::vector<ColumnChunk> carve(
+        const CSVOptions &options,
+        size_t rows,
+        void *arena
+    );
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <csv.h>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Sorts the rows of chunks by key columns before they are loaded, so that
+ * InnoDB appends to its primary key index instead of splitting pages all
+ * over it. The key is given as
+ *
+ *   COLUMN[,COLUMN...]
+ *
+ * with columns counted from 1, most significant first. Numeric, date and
+ * datetime keys are mapped to unsigned integers that order like the values
+ * and sorted with an LSD radix sort of the row numbers, skipping the bytes
+ * that are the same in every key; string keys are sorted by comparison.
+ * Rows are then copied a column at a time into a buffer in their new order.
+ *
+ * String keys are compared byte by byte, which is the index order only for
+ * binary collations such as utf8mb4_bin. Under a case or accent insensitive
+ * one, like the default utf8mb4_0900_ai_ci, the rows still load but may not
+ * arrive in index order, so sorting by a string key helps little there.
+ */
+class ChunkSorter {
+
+public:
+
+    /**
+     * What a thread sorts with, kept and reused from chunk to chunk.
+     */
+    class Buffer {
+
+    private:
+
+        friend class ChunkSorter;
+
+        std::vector<uint64_t> _keys;
+        std::vector<uint64_t> _keysTmp;
+        std::vector<uint32_t> _order;
+        std::vector<uint32_t> _orderTmp;
+
+        void *_arena = nullptr;
+        size_t _arenaSize = 0;
+        std::unique_ptr<ColumnarTableChunk> _chunk;
+
+    public:
+
+        Buffer() = default;
+
+        Buffer(const Buffer &) = delete;
+
+        ~Buffer();
+
+        Buffer & operator=(const Buffer &) = delete;
+    };
+
+private:
+
+    std::vector<CSVField> _fields;
+
+    // indexes of the key columns, most significant first
+    std::vector<size_t> _keys;
+
+    void _radixSort(Buffer &buffer, size_t n) const;
+
+    void _sortStrings(const ColumnChunk &column, Buffer &buffer) const;
+
+    ColumnarTableChunk * _gather(const ColumnarTableChunk *chunk, Buffer &buffer) const;
+
+public:
+
+    /**
+     * Parses spec for chunks of the given fields, throwing if it is
+     * malformed or names a column that does not exist.
+     */
+    ChunkSorter(const char *spec, const std::vector<CSVField> &fields);
+
+    const std::vector<CSVField> & fields() const {
+        return _fields;
+    }
+
+    /**
+     * Returns the rows of chunk sorted by the key, in a chunk held by
+     * buffer until its next use, or chunk itself if it is sorted already.
+     * chunk is not modified, so it may be read-only.
+     */
+    const ColumnarTableChunk * sort(const ColumnarTableChunk *chunk, Buffer &buffer) const;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <csv.h>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Writes parsed chunks to a columnar snapshot, so that a data set parsed
+ * once can be loaded again and again without parsing. The file holds a
+ * header with the column types, the column buffers of every chunk exactly
+ * as they are in memory, each aligned to 64 bytes, and an index of chunk
+ * boundaries at the end. Buffers are in the native byte order and layout,
+ * so a snapshot is only read back by builds for the same platform.
+ */
+class ColumnarFileWriter {
+
+private:
+
+    std::string _path;
+    std::vector<CSVField> _fields;
+    int _fd;
+    uint64_t _offset = 0;
+    uint64_t _rows = 0;
+
+    // chunk index, written out by close()
+    std::vector<uint64_t> _index;
+    size_t _chunks = 0;
+
+    void _write(const void *data, size_t size);
+
+    void _align();
+
+public:
+
+    /**
+     * Creates or truncates the file at path for chunks of the given fields.
+     */
+    ColumnarFileWriter(const char *path, const std::vector<CSVField> &fields);
+
+    ColumnarFileWriter(const ColumnarFileWriter &) = delete;
+
+    ~ColumnarFileWriter();
+
+    ColumnarFileWriter & operator=(const ColumnarFileWriter &) = delete;
+
+    /**
+     * Appends a chunk. Not thread-safe; chunks from several threads have to
+     * be handed to one writer in turn.
+     */
+    void write(const ColumnarTableChunk *chunk);
+
+    /**
+     * Writes the chunk index and closes the file, which is incomplete and
+     * unreadable until then.
+     */
+    void close();
+
+    uint64_t rows() const {
+        return _rows;
+    }
+
+    size_t chunks() const {
+        return _chunks;
+    }
+};
+
+/**
+ * A columnar snapshot mapped into memory. Chunks are views whose column
+ * buffers point straight into the mapping, so handing one out takes no
+ * parsing and no copying; pages are read in by the kernel as the loader
+ * touches them.
+ */
+class ColumnarFile {
+
+private:
+
+    std::string _path;
+    std::vector<CSVField> _fields;
+
+    void *_map = nullptr;
+    size_t _length = 0;
+
+    const uint64_t *_index = nullptr;
+    size_t _chunks = 0;
+    uint64_t _rows = 0;
+
+public:
+
+    /**
+     * Maps the snapshot at path, throwing if it is not one or is damaged.
+     */
+    ColumnarFile(const char *path);
+
+    ColumnarFile(const ColumnarFile &) = delete;
+
+    ~ColumnarFile();
+
+    ColumnarFile & operator=(const ColumnarFile &) = delete;
+
+    const char * path() const {
+        return _path.c_str();
+    }
+
+    const std::vector<CSVField> & fields() const {
+        return _fields;
+    }
+
+    size_t chunks() const {
+        return _chunks;
+    }
+
+    uint64_t rows() const {
+        return _rows;
+    }
+
+    /**
+     * Returns a view of the chunk at index i, which the caller deletes. It
+     * does not own its buffers and must not outlive the file.
+     */
+    ColumnarTableChunk * chunk(size_t i) const;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+enum class Compression {
+    NONE,
+    GZIP,
+    ZSTD,
+    LZ4,
+};
+
+/**
+ * A zstd frame of a file, where it starts in the file and where its contents
+ * start in the decompressed stream.
+ */
+struct CompressedFrame {
+    uint64_t offset;
+    uint64_t contentOffset;
+    uint64_t contentSize;
+};
+
+/**
+ * Streams the decompressed contents of a gzip (.gz), zstd (.zst) or lz4
+ * (.lz4) file, the codec being chosen by extension. Concatenated streams,
+ * as written by pigz, pzstd or zstd -T, are read back to back. The file is
+ * mapped and fed to the decompressor straight from the mapping.
+ *
+ * Codecs are optional at build time (HAVE_ZLIB, HAVE_ZSTD, HAVE_LZ4); a file
+ * whose codec was left out is rejected with an error.
+ */
+class CompressedInput {
+
+private:
+
+    std::string _path;
+    Compression _compression;
+
+    void *_map = nullptr;
+    size_t _length = 0;
+
+    // compressed input not yet handed to the decompressor
+    const char *_in;
+    const char *_inEnd;
+
+    // the decompressor state, z_stream, ZSTD_DStream or LZ4F_dctx
+    void *_stream = nullptr;
+    bool _done = false;
+
+    // whether the decompressor is inside a frame, and may hold output back
+    bool _inFrame = false;
+
+    // decompressed bytes to drop before the start offset
+    uint64_t _skip = 0;
+
+    size_t _decompress(char *buf, size_t n);
+
+public:
+
+    /**
+     * The codec of the file at path, by its extension.
+     */
+    static Compression detect(const char *path);
+
+    /**
+     * Whether this build can read files of the given codec.
+     */
+    static bool supported(Compression compression);
+
+    /**
+     * The frames of a zstd file, or none if the file is not zstd compressed
+     * or the size of any frame's contents is not recorded in its header.
+     * Frames decompress independently, so a file of several frames can be
+     * read by several threads at once.
+     */
+    static std::vector<CompressedFrame> frames(const char *path);
+
+    /**
+     * Decompresses the file open at fd from the given offset of its
+     * decompressed contents. Files of several zstd frames start at the frame
+     * that holds the offset; others are decompressed from the start.
+     */
+    CompressedInput(int fd, const char *path, Compression compression, uint64_t start = 0);
+
+    CompressedInput(const CompressedInput &) = delete;
+
+    ~CompressedInput();
+
+    CompressedInput & operator=(const CompressedInput &) = delete;
+
+    /**
+     * Reads up to n decompressed bytes into buf, returning 0 at the end.
+     */
+    size_t read(char *buf, size_t n);
+};
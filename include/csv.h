@@ -1,7 +1,10 @@
 #pragma once
 
 #include <types.h>
+#include <memory>
 #include <vector>
+#include <string>
+#include <stdint.h>
 
 struct CSVField {
     DataType type;
@@ -25,6 +28,19 @@ struct CSVOptions {
 
     size_t maxChunkSize = 16 * 1024 * 1024;
 
+    // expected average length of string values as a fraction of their
+    // declared size, used to size the string buffers of a chunk
+    double stringFill = 0.5;
+
+    // bytes read from the file at a time by CSVReader
+    size_t blockSize = 4 * 1024 * 1024;
+
+    // parse straight out of a read-only mapping of the file instead of
+    // reading it into blocks, optionally prefaulting the mapped range;
+    // compressed files are always read into blocks
+    bool mmap = false;
+    bool populate = false;
+
     std::vector<CSVField> fields;
 
     CSVOptions(const std::vector<CSVField> &fields)
@@ -32,6 +48,200 @@ struct CSVOptions {
     { }
 };
 
+class ChunkPool;
+class CompressedInput;
+
+/**
+ * A byte range [begin, end) of a CSV file. A range owns the records whose
+ * first byte falls inside it, so ranges can be cut at arbitrary offsets and
+ * parsed independently. Offsets of compressed files are offsets into their
+ * decompressed contents.
+ */
+struct CSVRange {
+    size_t begin;
+    size_t end;
+};
+
+/**
+ * Parses complete CSV lines into chunks. Input is handed over one block of
+ * lines at a time and rows accumulate in the current chunk across blocks, so
+ * blocks of any size, from any file, can be fed to the same parser.
+ */
+class CSVParser {
+
+private:
+
+    const CSVOptions &_options;
+    ChunkPool *_pool;
+    size_t _maxRows;
+
+    // indexes of the string columns, whose buffers may fill up before the
+    // chunk reaches its row capacity
+    std::vector<size_t> _stringColumns;
+
+    ColumnarTableChunk *_chunk = nullptr;
+    size_t _rows = 0;
+
+    // current input, and where it came from for error messages
+    const char *_pos = nullptr;
+    const char *_end = nullptr;
+    const char *_begin = nullptr;
+    const char *_path = "";
+    size_t _offset = 0;
+
+    // offsets of delimiters and newlines found by CSVScanner, relative to
+    // _scanBase, and the end of the data indexed so far
+    std::vector<uint32_t> _structural;
+    size_t _structuralPos = 0;
+    size_t _structuralCount = 0;
+    const char *_scanBase;
+    const char *_scanned;
+
+    const char * _nextStructural();
+
+    bool _stringsFit() const;
+
+    void _parseRow();
+
+    ColumnarTableChunk * _finishChunk();
+
+public:
+
+    /**
+     * Chunks are taken from pool if one is given, and must then be released
+     * back to it rather than deleted.
+     */
+    CSVParser(const CSVOptions &options, ChunkPool *pool = nullptr);
+
+    CSVParser(const CSVParser &) = delete;
+
+    ~CSVParser();
+
+    CSVParser & operator=(const CSVParser &) = delete;
+
+    /**
+     * Sets the next input, complete lines in [begin, end) found at the given
+     * offset of path. The input must stay valid until parse() has consumed it.
+     */
+    void setInput(const char *begin, const char *end, const char *path, size_t offset);
+
+    /**
+     * Parses rows from the input until the current chunk is full and returns
+     * it, or returns nullptr once the input is exhausted, keeping the chunk
+     * open for more input.
+     */
+    ColumnarTableChunk * parse();
+
+    /**
+     * Returns the partially filled chunk, if it holds any rows.
+     */
+    ColumnarTableChunk * flush();
+};
+
+/**
+ * Incremental CSV reader. The file is read in blocks of
+ * CSVOptions::blockSize bytes, lines that straddle a block boundary are
+ * carried over to the next block, and parsed rows are handed out one chunk
+ * at a time, so memory use is bounded by one block plus the chunks the
+ * caller still holds. Files ending in .gz, .zst or .lz4 are decompressed as
+ * they are read.
+ */
+class CSVReader {
+
+private:
+
+    std::string _path;
+    const CSVOptions &_options;
+    CSVParser _parser;
+
+    int _fd;
+    bool _mapped;
+    bool _eof = false;
+    bool _header;
+    bool _skipPartialLine;
+
+    // file offsets of _data, of the next read, and of the end of the range
+    // being read
+    size_t _offset;
+    size_t _readOffset;
+    size_t _rangeEnd;
+
+    // block buffer, unused when the file is mapped
+    char *_buffer = nullptr;
+    size_t _capacity;
+
+    void *_map = nullptr;
+    size_t _mapLength = 0;
+
+    // decompresses the file, if it is compressed
+    std::unique_ptr<CompressedInput> _input;
+
+    // start of the data in memory, which is at file offset _offset
+    const char *_data;
+
+    // unparsed data, and the end of the last complete line within it
+    const char *_pos;
+    const char *_end;
+    const char *_lineEnd;
+
+    void _read();
+
+    void _mapFile();
+
+    bool _fill();
+
+public:
+
+    CSVReader(const char *path, const CSVOptions &options);
+
+    /**
+     * Reads only the records that start inside the given range, or of a
+     * compressed file, that start inside it shifted a byte later, so that a
+     * range starting at a zstd frame need not look into the frame before.
+     * The header line, if any, is skipped only by the range that starts at
+     * offset 0.
+     * Chunks are taken from pool if one is given, and must then be released
+     * back to it rather than deleted.
+     */
+    CSVReader(
+        const char *path,
+        const CSVOptions &options,
+        const CSVRange &range,
+        ChunkPool *pool = nullptr
+    );
+
+    CSVReader(const CSVReader &) = delete;
+
+    ~CSVReader();
+
+    CSVReader & operator=(const CSVReader &) = delete;
+
+    const char * path() const {
+        return _path.c_str();
+    }
+
+    /**
+     * Whether blocks point into a mapping of the file, rather than into a
+     * buffer that the next block overwrites.
+     */
+    bool mapped() const {
+        return _mapped;
+    }
+
+    /**
+     * Returns the next run of complete lines, of at most about
+     * CSVOptions::blockSize bytes, and its file offset, or false once the
+     * range is exhausted. The lines stay valid until the next call.
+     */
+    bool nextBlock(const char *&begin, const char *&end, size_t &offset);
+
+    /**
+     * Parses the next chunk of rows, returns nullptr once the file is
+     * exhausted. The caller takes ownership of the chunk.
+     */
+    ColumnarTableChunk * nextChunk();
+};
+
 class CSV {
 
 public:
@@ -41,4 +251,55 @@ public:
         const CSVOptions &options
     );
 
+    /**
+     * Bytes taken by one value of the field in a chunk column, at most for
+     * strings.
+     */
+    static size_t fieldSize(const CSVField &field);
+
+    /**
+     * Bytes reserved for the values of a string column of the given number of
+     * rows, which always leaves room for at least one value of maximum size.
+     */
+    static size_t stringCapacity(
+        const CSVOptions &options,
+        const CSVField &field,
+        size_t rows
+    );
+
+    /**
+     * Number of rows that fit in a chunk of CSVOptions::maxChunkSize bytes.
+     */
+    static size_t rowsPerChunk(const CSVOptions &options);
+
+    /**
+     * Appends rows rows[0] to rows[n - 1] of src to dst, chunks of the given
+     * fields, where dst already holds dstRows rows and has room for
+     * capacity. Stops early once dst is full or the next row's strings do
+     * not fit, and returns the number of rows appended. Sizes of dst are
+     * left to the caller.
+     */
+    static size_t gather(
+        const std::vector<CSVField> &fields,
+        ColumnarTableChunk *dst,
+        size_t dstRows,
+        size_t capacity,
+        const ColumnarTableChunk *src,
+        const uint32_t *rows,
+        size_t n
+    );
+
+    /**
+     * Splits a file into at most n ranges of at least minSize bytes each.
+     * A compressed file is a single range of unknown length, unless it is
+     * made of zstd frames that record their size, which are split at frame
+     * boundaries so that several readers decompress it at once. There is
+     * always at least one range, which is empty for an empty file.
+     */
+    static std::vector<CSVRange> split(
+        const char *path,
+        size_t n,
+        size_t minSize
+    );
+
 };
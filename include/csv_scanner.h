@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Locates the structural characters of a CSV buffer, i.e. field delimiters
+ * and newlines, and emits their offsets in bulk. The vectorized scan builds
+ * a bitmask of matches for each 64-byte block (AVX2, or SSE2 on older
+ * targets) and expands it into offsets, instead of testing bytes one by one.
+ */
+class CSVScanner {
+
+public:
+
+    /**
+     * Writes the offsets, relative to p, of every delimiter and newline in
+     * the first len bytes of p to offsets, which must hold len entries, and
+     * returns their number.
+     */
+    static size_t scan(
+        const char *p,
+        size_t len,
+        char delimiter,
+        uint32_t *offsets
+    );
+
+    /**
+     * Byte-by-byte reference implementation of scan.
+     */
+    static size_t scanScalar(
+        const char *p,
+        size_t len,
+        char delimiter,
+        uint32_t *offsets
+    );
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <csv.h>
+#include <random.h>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * How the values of one generated column are drawn.
+ *
+ *   sequence[:START]    START, START + 1, ... by row number (numbers)
+ *   uniform:A:B         uniformly from [A, B] (numbers)
+ *   zipf:S:N            Zipf distributed from 1 to N with exponent S (numbers)
+ *   random:MIN:MAX      MIN to MAX random letters, digits, - and _ (strings)
+ *   date_range:A:B      YYYY-MM-DD dates from A to B, plus a random time of
+ *                       day for datetimes
+ */
+struct ColumnDistribution {
+    enum class Kind {
+        SEQUENCE,
+        UNIFORM,
+        ZIPF,
+        RANDOM,
+        DATE_RANGE,
+    };
+
+    Kind kind = Kind::SEQUENCE;
+
+    // the start of a SEQUENCE, the bounds of an integer UNIFORM, the lengths
+    // of a RANDOM string or the days since 1970-01-01 of a DATE_RANGE
+    int64_t low = 0;
+    int64_t high = 0;
+
+    // the bounds of a UNIFORM of floating point values
+    double realLow = 0;
+    double realHigh = 0;
+
+    std::shared_ptr<const ZipfDistribution> zipf;
+
+    /**
+     * Parses spec for a column of the given field, throwing if it is
+     * malformed or does not apply to the field's type.
+     */
+    static ColumnDistribution parse(const char *spec, const CSVField &field);
+
+    /**
+     * The distribution of a column without a spec: a sequence from 1 for
+     * numbers, random strings up to the declared size and dates from
+     * 1970-01-01 to 2037-12-31.
+     */
+    static ColumnDistribution defaultFor(const CSVField &field);
+};
+
+/**
+ * Fills chunks with synthetic rows, in place of parsing them from CSV. Row
+ * ranges are generated independently and every range gets the same values
+ * whichever thread generates it and in whatever order, so a data set is
+ * reproducible from its seed and chunk size however many threads build it.
+ */
+class DataGenerator {
+
+private:
+
+    std::vector<ColumnDistribution> _columns;
+    uint64_t _seed;
+
+    void _fillColumn(
+        ColumnChunk &column,
+        size_t index,
+        uint64_t firstRow,
+        size_t rows
+    ) const;
+
+public:
+
+    /**
+     * Creates a generator of rows with one column for every distribution.
+     */
+    DataGenerator(const std::vector<ColumnDistribution> &columns, uint64_t seed);
+
+    /**
+     * Fills the first rows rows of chunk with rows [firstRow, firstRow +
+     * rows) of the data set. The chunk must come from a ChunkPool or
+     * allocation sized with stringFill(), so that its strings always fit.
+     */
+    void fill(ColumnarTableChunk *chunk, uint64_t firstRow, size_t rows) const;
+
+    /**
+     * The CSVOptions::stringFill that leaves room for the longest strings
+     * the columns can produce.
+     */
+    static double stringFill(
+        const CSVOptions &options,
+        const std::vector<ColumnDistribution> &columns
+    );
+};
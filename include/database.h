@@ -1,7 +1,48 @@
 #pragma once
 
 #include <types.h>
+#include <parameterized_query.h>
+#include <exception.h>
 #include <string>
+#include <vector>
+
+enum class LoadMethod {
+    STMT,
+    MULTIROW,
+    INFILE,
+};
+
+struct LoadOptions {
+    LoadMethod method = LoadMethod::MULTIROW;
+
+    // number of rows sent per INSERT statement with LoadMethod::MULTIROW
+    size_t batchRows = 256;
+};
+
+/**
+ * An error the server returned for a query. Transient errors, deadlocks and
+ * lock wait timeouts, abort the transaction they occur in and are expected
+ * to go away if it is run again.
+ */
+class QueryError
+:   public spl::DynamicMessageError
+{
+
+private:
+
+    bool _transient;
+
+public:
+
+    QueryError(const char *message, bool transient)
+    :   spl::DynamicMessageError(message),
+        _transient(transient)
+    { }
+
+    bool transient() const {
+        return _transient;
+    }
+};
 
 class Database {
 
@@ -11,8 +52,22 @@ public:
 
     virtual void query(const std::string &sql) const = 0;
 
+    /**
+     * Runs a query and returns the rows of its result, with NULL values as
+     * empty strings.
+     */
+    virtual std::vector<std::vector<std::string>> fetch(const std::string &sql) const = 0;
+
+    /**
+     * Runs a query through a server-side prepared statement, which is
+     * prepared the first time its SQL is seen on this connection and reused
+     * with new parameters after that.
+     */
+    virtual void execute(const ParameterizedQuery &query) const = 0;
+
     virtual void loadIntoTable(
         const std::string &table,
-        const ColumnarTableChunk *chunk
+        const ColumnarTableChunk *chunk,
+        const LoadOptions &options
     ) const = 0;
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * A secondary index dropped for the duration of a load.
+ */
+struct DeferredIndex {
+    std::string name;
+
+    // as in SHOW CREATE TABLE, e.g. KEY `k_a` (`a`,`b`)
+    std::string definition;
+};
+
+/**
+ * The secondary indexes of a table that are cheaper to build once the table
+ * is loaded than to maintain row by row while it is. They are picked from
+ * the CREATE TABLE statement the server reports for the table: every plain
+ * KEY, except one that a foreign key needs. The primary key, which InnoDB
+ * stores the rows in, unique keys, which would no longer reject duplicates,
+ * and fulltext and spatial indexes, which InnoDB does not build more than
+ * one of at a time, are kept.
+ */
+class DeferredIndexes {
+
+private:
+
+    std::string _table;
+    std::vector<DeferredIndex> _indexes;
+
+public:
+
+    /**
+     * Picks the deferrable indexes of table out of createTable, the second
+     * column of SHOW CREATE TABLE.
+     */
+    DeferredIndexes(const std::string &table, const std::string &createTable);
+
+    const std::string & table() const {
+        return _table;
+    }
+
+    const std::vector<DeferredIndex> & indexes() const {
+        return _indexes;
+    }
+
+    /**
+     * An ALTER TABLE that drops every deferred index at once.
+     */
+    std::string dropStatement() const;
+
+    /**
+     * An ALTER TABLE that adds every deferred index back at once, so that
+     * the table is scanned a single time for all of them.
+     */
+    std::string addStatement() const;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <mysql.h>
+#include <charconv>
+#include <limits>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Length-bounded parsers for CSV fields. Fields are given as [p, end) and are
+ * never required to be null-terminated or writable, and no parser keeps state
+ * between calls, so they are safe to use from any number of threads. Every
+ * parser returns false on malformed or out of range input.
+ */
+class FieldParser {
+
+private:
+
+    static inline bool _digits(const char *p, size_t n, unsigned int &value) {
+        unsigned int v = 0;
+        for (size_t i = 0; i < n; ++i) {
+            unsigned int d = (unsigned char) p[i] - '0';
+            if (d > 9) return false;
+            v = v * 10 + d;
+        }
+        value = v;
+        return true;
+    }
+
+    static inline bool _number(const char *&p, const char *end, char sep, unsigned int &value) {
+        const char *q = p;
+        while (q != end && *q != sep) ++q;
+        if (q == p || q - p > 9 || ! _digits(p, q - p, value)) return false;
+        p = q == end ? q : q + 1;
+        return true;
+    }
+
+    // the digits of [p, end), without a sign; false if they overflow
+    static inline bool _magnitude(const char *p, const char *end, uint64_t &value) {
+        uint64_t v = 0;
+        bool overflow = false;
+        for (; p != end; ++p) {
+            unsigned int d = (unsigned char) *p - '0';
+            if (d > 9) return false;
+            overflow |= __builtin_mul_overflow(v, 10, &v);
+            overflow |= __builtin_add_overflow(v, d, &v);
+        }
+
+        value = v;
+        return ! overflow;
+    }
+
+public:
+
+    /**
+     * Parses a decimal unsigned integer. An empty field parses as 0.
+     */
+    template <class T>
+    static inline bool parseUnsigned(const char *p, const char *end, T &value) {
+        static_assert(std::is_unsigned<T>::value, "unsigned type expected");
+
+        if (p != end && *p == '+' && ++p == end) return false;
+
+        uint64_t v;
+        if (! _magnitude(p, end, v) || v > std::numeric_limits<T>::max()) return false;
+        value = (T) v;
+        return true;
+    }
+
+    /**
+     * Parses a decimal signed integer. An empty field parses as 0.
+     */
+    template <class T>
+    static inline bool parseSigned(const char *p, const char *end, T &value) {
+        static_assert(std::is_signed<T>::value, "signed type expected");
+
+        bool negative = p != end && *p == '-';
+        if (p != end && (*p == '-' || *p == '+')) {
+            if (++p == end) return false;
+        }
+
+        // digits only, so that a second sign is rejected
+        uint64_t v;
+        if (! _magnitude(p, end, v)) return false;
+
+        // the magnitude of the minimum is one more than the maximum
+        uint64_t limit = (uint64_t) std::numeric_limits<T>::max() + negative;
+        if (v > limit) return false;
+
+        value = negative ? (T) (0 - v) : (T) v;
+        return true;
+    }
+
+    /**
+     * Parses a decimal or scientific floating point number. An empty field
+     * parses as 0.
+     */
+    template <class T>
+    static inline bool parseFloat(const char *p, const char *end, T &value) {
+        if (p == end) {
+            value = 0;
+            return true;
+        }
+        // from_chars takes a '-' but no '+', and neither after a '+'
+        if (*p == '+' && (++p == end || *p == '-')) return false;
+
+        auto r = std::from_chars(p, end, value);
+        return r.ec == std::errc() && r.ptr == end;
+    }
+
+    /**
+     * Parses a YYYY-MM-DD date. Fields that do not have the fixed layout,
+     * e.g. with single digit months, take a slower path.
+     */
+    static inline bool parseDate(const char *p, const char *end, MYSQL_TIME &t) {
+        t = MYSQL_TIME();
+        t.time_type = MYSQL_TIMESTAMP_DATE;
+
+        if (end - p == 10 && p[4] == '-' && p[7] == '-') {
+            if (! _digits(p, 4, t.year)
+                || ! _digits(p + 5, 2, t.month)
+                || ! _digits(p + 8, 2, t.day)
+            ) {
+                return false;
+            }
+        }
+        else if (! _number(p, end, '-', t.year)
+            || ! _number(p, end, '-', t.month)
+            || ! _number(p, end, '-', t.day)
+            || p != end
+        ) {
+            return false;
+        }
+
+        return t.month <= 12 && t.day <= 31;
+    }
+
+    /**
+     * Parses a YYYY-MM-DD HH:MM:SS datetime, with an optional fraction of up
+     * to 6 digits. A plain date parses as midnight.
+     */
+    static inline bool parseDateTime(const char *p, const char *end, MYSQL_TIME &t) {
+        const char *time = p;
+        while (time != end && *time != ' ' && *time != 'T') ++time;
+
+        if (! parseDate(p, time, t)) return false;
+        t.time_type = MYSQL_TIMESTAMP_DATETIME;
+        if (time == end) return true;
+        ++time;
+
+        const char *fraction = time;
+        while (fraction != end && *fraction != '.') ++fraction;
+
+        if (fraction - time == 8 && time[2] == ':' && time[5] == ':') {
+            if (! _digits(time, 2, t.hour)
+                || ! _digits(time + 3, 2, t.minute)
+                || ! _digits(time + 6, 2, t.second)
+            ) {
+                return false;
+            }
+        }
+        else if (! _number(time, fraction, ':', t.hour)
+            || ! _number(time, fraction, ':', t.minute)
+            || ! _number(time, fraction, ':', t.second)
+            || time != fraction
+        ) {
+            return false;
+        }
+
+        if (fraction != end) {
+            ++fraction;
+            size_t n = end - fraction;
+            unsigned int micros;
+            if (n == 0 || n > 6 || ! _digits(fraction, n, micros)) return false;
+            for (; n < 6; ++n) micros *= 10;
+            t.second_part = micros;
+        }
+
+        return t.hour <= 23 && t.minute <= 59 && t.second <= 59;
+    }
+};
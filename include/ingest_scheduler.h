@@ -0,0 +1,96 @@
+#pragma once
+
+#include <csv.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A slice of an input file for one reader to read.
+ */
+struct CSVWork {
+    std::string path;
+    CSVRange range;
+};
+
+/**
+ * Shares the files of a load out among reader threads. Files are cut into
+ * slices of about the same size, so a big file is read by many readers while
+ * small ones are read whole, and slices are dealt out largest first to the
+ * reader with the least work so far. Every reader works through its own
+ * queue and, once that runs dry, steals from the back of the queue with the
+ * most work left, so no reader idles while another still has slices to go.
+ *
+ * Compressed files that cannot be split are read whole and go first, as
+ * they take the longest for their size and nothing else can share them.
+ */
+class IngestScheduler {
+
+private:
+
+    struct Slice {
+        CSVWork work;
+        uint64_t bytes;
+    };
+
+    struct Queue {
+        std::mutex mtx;
+        std::deque<Slice> slices;
+        uint64_t bytes = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+
+    size_t _files = 0;
+    size_t _slices = 0;
+    uint64_t _bytes = 0;
+    std::atomic<size_t> _steals;
+
+    bool _steal(size_t worker, CSVWork &work);
+
+public:
+
+    /**
+     * Plans the slices of the files at paths for the given number of
+     * workers. No slice of a splittable file is smaller than minSize bytes.
+     */
+    IngestScheduler(const std::vector<std::string> &paths, size_t workers, size_t minSize);
+
+    IngestScheduler(const IngestScheduler &) = delete;
+
+    IngestScheduler & operator=(const IngestScheduler &) = delete;
+
+    /**
+     * Takes the next slice for the given worker, returning false once every
+     * slice has been taken. Thread-safe.
+     */
+    bool next(size_t worker, CSVWork &work);
+
+    size_t files() const {
+        return _files;
+    }
+
+    size_t slices() const {
+        return _slices;
+    }
+
+    /**
+     * The bytes to read, counting compressed files of unknown length by their
+     * size on disk.
+     */
+    uint64_t bytes() const {
+        return _bytes;
+    }
+
+    /**
+     * The slices taken from another worker's queue.
+     */
+    size_t steals() const {
+        return _steals;
+    }
+};
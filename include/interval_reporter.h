@@ -0,0 +1,118 @@
+#pragma once
+
+#include <latency_histogram.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <thread>
+
+/**
+ * Prints throughput, error counts and latency percentiles for every interval
+ * of a run, to stdout and optionally to a time-series file, from a thread of
+ * its own. Each worker thread counts into its own Counters, which only that
+ * thread writes; the reporter reads them without a lock and reports the
+ * difference from the previous interval.
+ */
+class IntervalReporter {
+
+public:
+
+    enum class Format {
+        CSV,
+        JSON,
+    };
+
+    class Counters {
+
+    private:
+
+        friend class IntervalReporter;
+
+        std::atomic<uint64_t> _queries { 0 };
+        std::atomic<uint64_t> _rows { 0 };
+        std::atomic<uint64_t> _errors { 0 };
+        LatencyHistogram _latency;
+
+        static void _add(std::atomic<uint64_t> &c, uint64_t n) {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+    public:
+
+        /**
+         * Counts a query, or a chunk loaded, that took the given time and
+         * wrote the given number of rows.
+         */
+        void query(uint64_t nanoseconds, uint64_t rows = 0) {
+            _add(_queries, 1);
+            _add(_rows, rows);
+            _latency.record(nanoseconds);
+        }
+
+        void error() {
+            _add(_errors, 1);
+        }
+    };
+
+private:
+
+    struct Source {
+        const Counters *counters;
+        uint64_t queries = 0;
+        uint64_t rows = 0;
+        uint64_t errors = 0;
+        LatencyHistogram latency;
+    };
+
+    std::chrono::duration<double> _interval;
+    Format _format;
+    std::ofstream _file;
+
+    std::mutex _mtx;
+    std::condition_variable _wakeup;
+    bool _stop = false;
+    std::thread _thread;
+
+    std::list<Counters> _counters;
+    std::list<Source> _sources;
+
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last;
+
+    void _run();
+
+    void _report(std::chrono::steady_clock::time_point now);
+
+public:
+
+    /**
+     * Creates a reporter for intervals of the given number of seconds, that
+     * also writes to the file at path unless it is null.
+     */
+    IntervalReporter(double interval, const char *path, Format format);
+
+    IntervalReporter(const IntervalReporter &) = delete;
+
+    ~IntervalReporter();
+
+    IntervalReporter & operator=(const IntervalReporter &) = delete;
+
+    /**
+     * Returns a new set of counters for the calling thread to write. They
+     * live as long as the reporter.
+     */
+    Counters * counters();
+
+    /**
+     * Starts reporting; times are reported relative to now.
+     */
+    void start();
+
+    /**
+     * Reports the last, partial interval and stops the reporter thread.
+     */
+    void stop();
+};
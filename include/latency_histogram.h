@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+
+/**
+ * A log-linear (HDR-style) histogram of latencies in nanoseconds. Values are
+ * grouped by their highest set bit and each power of two is split into
+ * SUB_BUCKETS / 2 linear sub-buckets, so every recorded value is known to
+ * within about 3% while the histogram stays a fixed array of counters from
+ * one nanosecond up to MAX_VALUE. Recording is a shift and an increment and
+ * takes no lock; each thread records into its own histogram and the
+ * histograms are merged once the run is over.
+ *
+ * Only one thread may record into a histogram, but the counters are relaxed
+ * atomics so that others can read it while it is being written, e.g. to
+ * report the latencies of the last interval during a run.
+ */
+class LatencyHistogram {
+
+private:
+
+    static constexpr unsigned SUB_BUCKET_BITS = 6;
+    static constexpr uint64_t SUB_BUCKETS = (uint64_t) 1 << SUB_BUCKET_BITS;
+    static constexpr uint64_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+
+    using Counter = std::atomic<uint64_t>;
+
+    std::unique_ptr<Counter[]> _counts;
+    Counter _count;
+    Counter _sum;
+    Counter _min;
+    Counter _max;
+
+    // a plain read-modify-write, which is safe with a single writer and
+    // compiles to ordinary loads and stores
+    static void _add(Counter &c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static uint64_t _get(const Counter &c) {
+        return c.load(std::memory_order_relaxed);
+    }
+
+    static void _set(Counter &c, uint64_t n) {
+        c.store(n, std::memory_order_relaxed);
+    }
+
+    static size_t _index(uint64_t value) {
+        if (value < SUB_BUCKETS) return value;
+
+        unsigned shift = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+        return shift * HALF_SUB_BUCKETS + (value >> shift);
+    }
+
+    // smallest and largest values that fall in the bucket at index
+    static uint64_t _lowestEquivalent(size_t index);
+    static uint64_t _highestEquivalent(size_t index);
+
+    static size_t _numBuckets() {
+        return _index(MAX_VALUE) + 1;
+    }
+
+public:
+
+    // values above this (about 18 minutes) are counted as this
+    static constexpr uint64_t MAX_VALUE = ((uint64_t) 1 << 40) - 1;
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram &other);
+
+    LatencyHistogram & operator=(const LatencyHistogram &other);
+
+    void record(uint64_t nanoseconds) {
+        if (nanoseconds > MAX_VALUE) nanoseconds = MAX_VALUE;
+
+        _add(_counts[_index(nanoseconds)], 1);
+        _add(_count, 1);
+        _add(_sum, nanoseconds);
+        if (nanoseconds < _get(_min)) _set(_min, nanoseconds);
+        if (nanoseconds > _get(_max)) _set(_max, nanoseconds);
+    }
+
+    void merge(const LatencyHistogram &other);
+
+    /**
+     * Adds what was recorded into current since it was copied to previous.
+     * The minimum and maximum of that difference are only known to within
+     * a bucket.
+     */
+    void mergeDifference(
+        const LatencyHistogram &current,
+        const LatencyHistogram &previous
+    );
+
+    void reset();
+
+    uint64_t count() const {
+        return _get(_count);
+    }
+
+    uint64_t min() const {
+        return count() == 0 ? 0 : _get(_min);
+    }
+
+    uint64_t max() const {
+        return _get(_max);
+    }
+
+    double mean() const {
+        return count() == 0 ? 0 : (double) _get(_sum) / count();
+    }
+
+    /**
+     * Returns the latency at or below which the given percentage (0-100) of
+     * recorded values fall, i.e. the upper end of the bucket holding that
+     * rank, capped at the largest recorded value.
+     */
+    uint64_t percentile(double percent) const;
+
+    /**
+     * Writes the column names matching writeCSV.
+     */
+    static void writeCSVHeader(std::ostream &out);
+
+    /**
+     * Writes one line of summary statistics, in seconds, labelled with scope
+     * and name; name is quoted as needed.
+     */
+    void writeCSV(std::ostream &out, const char *scope, const std::string &name) const;
+
+    /**
+     * Writes a one-line human-readable summary, in milliseconds.
+     */
+    void print(std::ostream &out) const;
+};
@@ -4,6 +4,7 @@
 #include <csv.h>
 #include <mysql.h>
 #include <exception.h>
+#include <unordered_map>
 
 using namespace spl;
 
@@ -15,6 +16,14 @@ private:
 
     MYSQL _mysql;
 
+    // prepared statements by SQL text; null marks SQL that the server
+    // refused to prepare, which is then sent as text
+    mutable std::unordered_map<std::string, MYSQL_STMT *> _statements;
+
+    // the session settings that bulk loading relaxes, as the connection
+    // had them before its first load, to be put back after each
+    mutable std::string _restoreSession;
+
     MySQLDatabase() {
         if (! mysql_init(&_mysql)) {
             throw RuntimeError("Insufficient memory");
@@ -25,6 +34,41 @@ private:
         return (MYSQL *) &_mysql;
     }
 
+    /**
+     * Returns the prepared statement for sql, preparing it if it is not
+     * cached yet and throwing if the server refuses it.
+     */
+    MYSQL_STMT * _statement(const std::string &sql) const;
+
+    /**
+     * Prepares sql as a statement that is not cached and that the caller
+     * must close, throwing if the server refuses it.
+     */
+    MYSQL_STMT * _prepare(const std::string &sql) const;
+
+    void _cacheStatement(const std::string &sql, MYSQL_STMT *stmt) const;
+
+    void _evictStatement(const std::string &sql) const;
+
+    void _clearStatements() const;
+
+    /**
+     * Throws the error of the last query, after resetting the connection
+     * to a known state.
+     */
+    void _queryFailed() const;
+
+    void _insertRows(
+        const std::string &table,
+        const ColumnarTableChunk *chunk,
+        size_t batchRows
+    ) const;
+
+    void _loadInfile(
+        const std::string &table,
+        const ColumnarTableChunk *chunk
+    ) const;
+
 public:
 
     MySQLDatabase(
@@ -32,16 +76,22 @@ public:
         const char *user,
         const char *password,
         const char *db,
-        unsigned int port = 0
+        unsigned int port = 0,
+        bool localInfile = false
     );
 
     ~MySQLDatabase();
 
     void query(const std::string &sql) const override;
 
+    std::vector<std::vector<std::string>> fetch(const std::string &sql) const override;
+
+    void execute(const ParameterizedQuery &query) const override;
+
     void loadIntoTable(
         const std::string &table,
-        const ColumnarTableChunk *chunk
+        const ColumnarTableChunk *chunk,
+        const LoadOptions &options
     ) const override;
 
 private:
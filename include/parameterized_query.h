@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct QueryParameter {
+    enum class Type {
+        INTEGER,
+        DECIMAL,
+        DOUBLE,
+        STRING,
+    };
+
+    Type type;
+
+    // the value of an INTEGER or DOUBLE
+    long long integer = 0;
+    double real = 0;
+
+    // the digits of a DECIMAL, or the unescaped contents of a STRING
+    std::string text;
+};
+
+/**
+ * A query with its literals taken out as parameters, so that queries that
+ * only differ in their constants share one server-side prepared statement.
+ * Numbers and single-quoted strings become placeholders, except where a
+ * placeholder would change the meaning of the query or is not allowed:
+ * positions in ORDER BY and GROUP BY lists, typed literals such as
+ * DATE '1998-12-01', and literals with a character set or radix prefix.
+ * Comments, double-quoted and backquoted text are left as they are.
+ */
+class ParameterizedQuery {
+
+public:
+
+    // the query as written
+    std::string text;
+
+    // the query with a ? in place of every parameter
+    std::string sql;
+
+    std::vector<QueryParameter> parameters;
+
+    ParameterizedQuery(const std::string &text);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <random.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * A query with placeholders for values generated afresh every time it runs,
+ * so that repeated queries spread over the data instead of hitting the same
+ * rows in the server's caches:
+ *
+ *   {uniform:A:B}       an integer from A to B, or a real number if A or B
+ *                       has a decimal point
+ *   {zipf:S:N}          a Zipf distributed integer from 1 to N with exponent
+ *                       S, 1 being the most frequent
+ *   {choice:FILE}       one of the lines of FILE, as written; relative paths
+ *                       start at the directory of the query file
+ *   {date_range:A:B}    a YYYY-MM-DD date from A to B
+ *
+ * Values are inserted as they are, so strings and dates need quotes around
+ * the placeholder: WHERE d = '{date_range:1992-01-01:1998-12-31}'. Braces
+ * that do not start one of these are left alone, e.g. in JSON literals.
+ *
+ * Templates are compiled when the query files are read: bounds are parsed,
+ * Zipf constants computed and choice files loaded once, and rendering only
+ * draws numbers and appends them to a buffer.
+ */
+class QueryTemplate {
+
+public:
+
+    /**
+     * Choice files by path, shared by the templates that use them.
+     */
+    using ChoiceFiles = std::map<std::string, std::shared_ptr<const std::vector<std::string>>>;
+
+private:
+
+    struct Generator {
+        enum class Kind {
+            INTEGER,
+            REAL,
+            ZIPF,
+            CHOICE,
+            DATE,
+        };
+
+        Kind kind;
+
+        // the text before the placeholder
+        size_t literalBegin;
+        size_t literalEnd;
+
+        // INTEGER and DATE (in days) values are low + [0, span)
+        int64_t low = 0;
+        uint64_t span = 0;
+
+        // REAL values are realLow + [0, realSpan)
+        double realLow = 0;
+        double realSpan = 0;
+
+        std::shared_ptr<const ZipfDistribution> zipf;
+        std::shared_ptr<const std::vector<std::string>> choices;
+    };
+
+    std::vector<Generator> _generators;
+
+    // where the text after the last placeholder starts
+    size_t _tail = 0;
+
+public:
+
+    // the query as written
+    std::string text;
+
+    /**
+     * Compiles text, reading choice files through files. Throws if a
+     * placeholder is malformed or a choice file cannot be read.
+     */
+    QueryTemplate(const std::string &text, const std::string &directory, ChoiceFiles &files);
+
+    /**
+     * Whether the query has any placeholders.
+     */
+    bool generated() const {
+        return ! _generators.empty();
+    }
+
+    /**
+     * Returns the query with fresh values, built in buffer, or the text
+     * itself if it has no placeholders.
+     */
+    const std::string & render(Random &random, std::string &buffer) const;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * The xoshiro256** generator: a few nanoseconds per number and good enough
+ * statistical quality for picking benchmark values. Not for cryptography.
+ * Each thread keeps its own, so generating values takes no locks.
+ */
+class Random {
+
+private:
+
+    uint64_t _s[4];
+
+    static uint64_t _rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+
+    /**
+     * Seeds the state with splitmix64, so nearby seeds give unrelated
+     * sequences.
+     */
+    explicit Random(uint64_t seed) {
+        for (auto &s : _s) {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            s = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = _rotl(_s[1] * 5, 7) * 9;
+        uint64_t t = _s[1] << 17;
+
+        _s[2] ^= _s[0];
+        _s[3] ^= _s[1];
+        _s[1] ^= _s[2];
+        _s[0] ^= _s[3];
+        _s[2] ^= t;
+        _s[3] = _rotl(_s[3], 45);
+
+        return result;
+    }
+
+    /**
+     * Returns a number in [0, n), without the bias of a modulo (Lemire's
+     * multiply-and-reject method). n = 0 stands for 2^64.
+     */
+    uint64_t below(uint64_t n) {
+        if (n == 0) return next();
+
+        __uint128_t m = (__uint128_t) next() * n;
+        uint64_t low = (uint64_t) m;
+
+        if (low < n) {
+            uint64_t threshold = -n % n;
+            while (low < threshold) {
+                m = (__uint128_t) next() * n;
+                low = (uint64_t) m;
+            }
+        }
+
+        return m >> 64;
+    }
+
+    /**
+     * Returns a number in [0, 1).
+     */
+    double uniform() {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+};
+
+/**
+ * Zipf distributed ranks in [1, n]: rank k comes up in proportion to
+ * 1 / k^s, so a few keys get most of the traffic. Samples by rejection-
+ * inversion (Hörmann and Derflinger), which needs a handful of constants
+ * computed once instead of a table of n probabilities, takes constant time
+ * per sample and works for any exponent s > 0, including the 0.99 of YCSB.
+ */
+class ZipfDistribution {
+
+private:
+
+    double _s;
+    uint64_t _n;
+
+    double _hIntegralX1;
+    double _hIntegralN;
+    double _threshold;
+
+    double _h(double x) const;
+
+    double _hIntegral(double x) const;
+
+    double _hIntegralInverse(double x) const;
+
+public:
+
+    ZipfDistribution(double s, uint64_t n);
+
+    uint64_t operator()(Random &random) const;
+
+    double exponent() const {
+        return _s;
+    }
+
+    uint64_t size() const {
+        return _n;
+    }
+};
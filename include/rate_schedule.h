@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * An open-loop timetable of sends at a fixed rate, shared by the connections
+ * of a run. Slot k is due at start + k / rate whether or not earlier queries
+ * have returned, so a slow server does not lower the offered load; each
+ * connection claims the next free slot and waits for its time. Latency is
+ * meant to be measured from a slot's intended time rather than from when it
+ * was actually sent, which charges the server for the queueing it causes
+ * (coordinated omission).
+ */
+class RateSchedule {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    // a send this far behind its slot counts as late
+    static constexpr Clock::duration LATE_THRESHOLD = std::chrono::milliseconds(1);
+
+private:
+
+    double _rate;
+    size_t _slots;
+    Clock::time_point _start;
+    Clock::time_point _end;
+
+    alignas(64) std::atomic<size_t> _next { 0 };
+    alignas(64) std::atomic<size_t> _issued { 0 };
+    std::atomic<size_t> _late { 0 };
+
+    Clock::time_point _due(size_t slot) const {
+        return _start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(slot / _rate)
+        );
+    }
+
+public:
+
+    /**
+     * Creates a schedule of rate sends per second, of at most slots sends.
+     */
+    RateSchedule(double rate, size_t slots = SIZE_MAX)
+    :   _rate(rate),
+        _slots(slots)
+    { }
+
+    /**
+     * Starts the timetable at start; slots due at or after end are not sent.
+     */
+    void start(
+        Clock::time_point start,
+        Clock::time_point end = Clock::time_point::max()
+    ) {
+        _start = start;
+        _end = end;
+    }
+
+    /**
+     * Claims the next slot and waits until it is due. Returns false once the
+     * schedule is over, either because every slot was claimed or because the
+     * end time has passed.
+     */
+    bool next(size_t &slot, Clock::time_point &intended);
+
+    double rate() const {
+        return _rate;
+    }
+
+    size_t issued() const {
+        return _issued.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of sends that went out more than LATE_THRESHOLD after their
+     * slot, because every connection was still busy.
+     */
+    size_t late() const {
+        return _late.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of slots due before the end time that were never sent.
+     */
+    size_t dropped() const;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+
+/**
+ * The timeline of a benchmark run. Connections are brought up one after
+ * another during ramp-up, the server's caches fill during warm-up, and only
+ * queries that start in the measured phase count towards the statistics of
+ * the run. A measured phase without a duration lasts until every stream
+ * has finished.
+ */
+class RunPhases {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Phase {
+        RAMP_UP,
+        WARM_UP,
+        MEASURED,
+    };
+
+    static constexpr size_t COUNT = 3;
+
+private:
+
+    Clock::duration _rampUp;
+    Clock::duration _warmUp;
+    Clock::duration _measured;
+    bool _bounded;
+
+    Clock::time_point _start;
+
+public:
+
+    /**
+     * Creates phases of the given lengths in seconds, with a measured phase
+     * of unbounded length if duration is 0.
+     */
+    RunPhases(double rampUp, double warmUp, double duration);
+
+    static const char * name(Phase phase);
+
+    void start(Clock::time_point start) {
+        _start = start;
+    }
+
+    /**
+     * When the given phase begins.
+     */
+    Clock::time_point begin(Phase phase) const;
+
+    /**
+     * When the run is over, or Clock::time_point::max() if its measured
+     * phase is unbounded.
+     */
+    Clock::time_point end() const;
+
+    /**
+     * The phase a query starting at t belongs to.
+     */
+    Phase at(Clock::time_point t) const;
+
+    /**
+     * When connection i of n becomes active, spread evenly over ramp-up.
+     * Connections past the first n become active once ramp-up is over.
+     */
+    Clock::time_point activation(size_t i, size_t n) const;
+
+    /**
+     * The time spent in the given phase by a run that finished at finish.
+     */
+    double seconds(Phase phase, Clock::time_point finish) const;
+
+    /**
+     * Whether the run has any phase before the measured one.
+     */
+    bool staged() const {
+        return _rampUp.count() > 0 || _warmUp.count() > 0;
+    }
+};
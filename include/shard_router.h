@@ -0,0 +1,107 @@
+#pragma once
+
+#include <csv.h>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Where the rows of one shard are loaded:
+ *
+ *   [HOST[:PORT]/]TABLE
+ *
+ * TABLE may be qualified with its schema. Without a host the shard is on
+ * the server of --host and --port.
+ */
+struct ShardTarget {
+    std::string host;
+    unsigned int port = 0;
+    std::string table;
+
+    /**
+     * Parses spec, throwing if it is malformed.
+     */
+    static ShardTarget parse(const char *spec);
+
+    std::string name() const;
+};
+
+/**
+ * The rows of a chunk grouped by shard: the numbers of the rows of shard s
+ * are rows[begins[s]] to rows[begins[s + 1] - 1], in their order in the
+ * chunk. Kept by the caller and reused from chunk to chunk.
+ */
+struct ShardPartition {
+    std::vector<uint32_t> shards;
+    std::vector<uint32_t> rows;
+    std::vector<size_t> begins;
+    std::vector<size_t> next;
+};
+
+/**
+ * Assigns the rows of chunks to shards by the value of a key column:
+ *
+ *   COLUMN:hash               by a hash of the value, for integer and
+ *                             string columns
+ *   COLUMN:range:B1:...:Bn-1  shard 0 holds values below B1, shard i values
+ *                             from Bi up to B(i+1), for integer columns
+ *
+ * COLUMN is the position of the key among the fields, counting from 1.
+ * Shards are computed a column at a time in tight loops over the key
+ * values, and rows are copied to the buffers of their shards a column at a
+ * time, which keeps routing cheap next to parsing and loading.
+ */
+class ShardRouter {
+
+public:
+
+    enum class Method {
+        HASH,
+        RANGE,
+    };
+
+private:
+
+    std::vector<CSVField> _fields;
+    size_t _shards;
+    size_t _column;
+    Method _method;
+    std::vector<int64_t> _bounds;
+
+    template <typename T>
+    void _assign(const T *values, size_t n, uint32_t *shards) const;
+
+    void _assignStrings(const ColumnChunk &column, uint32_t *shards) const;
+
+public:
+
+    /**
+     * Parses spec for rows of the given fields spread over shards shards,
+     * throwing if it is malformed or does not fit the fields.
+     */
+    ShardRouter(const char *spec, const std::vector<CSVField> &fields, size_t shards);
+
+    size_t shards() const {
+        return _shards;
+    }
+
+    /**
+     * Groups the rows of chunk by shard into partition.
+     */
+    void partition(const ColumnarTableChunk *chunk, ShardPartition &partition) const;
+
+    /**
+     * Appends the given rows of src to dst as CSV::gather does.
+     */
+    size_t gather(
+        ColumnarTableChunk *dst,
+        size_t dstRows,
+        size_t capacity,
+        const ColumnarTableChunk *src,
+        const uint32_t *rows,
+        size_t n
+    ) const {
+        return CSV::gather(_fields, dst, dstRows, capacity, src, rows, n);
+    }
+};
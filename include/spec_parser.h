@@ -0,0 +1,82 @@
+#pragma once
+
+#include <calendar.h>
+#include <exception.h>
+#include <field_parser.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Helpers for the small command line and template specs, e.g. column
+ * distributions, query placeholders and shard targets, which are made of
+ * colon separated parts. Unlike FieldParser, which they use for dates, they
+ * are not on any hot path and favour plain strings over bounded ranges.
+ */
+class SpecParser {
+
+public:
+
+    /**
+     * Throws "Invalid <what> '<spec>': <reason>".
+     */
+    static inline void fail(const char *what, const std::string &spec, const char *reason) {
+        std::stringstream msg;
+        msg << "Invalid " << what << " '" << spec << "': " << reason;
+        throw spl::DynamicMessageError(msg.str().c_str());
+    }
+
+    /**
+     * The parts of s between separators, a single one if there is none.
+     */
+    static inline std::vector<std::string> split(const std::string &s, char separator = ':') {
+        std::vector<std::string> parts;
+
+        size_t begin = 0;
+        for (;;) {
+            size_t end = s.find(separator, begin);
+            parts.push_back(s.substr(begin, end - begin));
+            if (end == std::string::npos) return parts;
+            begin = end + 1;
+        }
+    }
+
+    /**
+     * Parses a whole string as a decimal integer.
+     */
+    static inline bool parseInteger(const std::string &s, int64_t &value) {
+        if (s.empty()) return false;
+
+        char *end;
+        errno = 0;
+        value = strtoll(s.c_str(), &end, 10);
+        return *end == '\0' && errno == 0;
+    }
+
+    /**
+     * Parses a whole string as a real number.
+     */
+    static inline bool parseReal(const std::string &s, double &value) {
+        if (s.empty()) return false;
+
+        char *end;
+        value = strtod(s.c_str(), &end);
+        return *end == '\0';
+    }
+
+    /**
+     * Parses a YYYY-MM-DD date as days since 1970-01-01. Unlike a date
+     * field, it may not have a zero month or day.
+     */
+    static inline bool parseDay(const std::string &s, int64_t &days) {
+        MYSQL_TIME t;
+        if (! FieldParser::parseDate(s.data(), s.data() + s.size(), t)) return false;
+        if (t.month == 0 || t.day == 0) return false;
+
+        days = Calendar::daysFromCivil(t.year, t.month, t.day);
+        return true;
+    }
+};
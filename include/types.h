@@ -2,7 +2,7 @@
 
 #include <vector>
 #include <stdlib.h>
-#include <malloc.h>
+#include <stdint.h>
 
 enum class DataType {
     UINT8,
@@ -17,6 +17,7 @@ enum class DataType {
     FLOAT64,
     STRING,
     MYSQL_DATE,
+    MYSQL_DATETIME,
 };
 
 struct ColumnChunk {
@@ -24,16 +25,42 @@ struct ColumnChunk {
     void *data;
     size_t size;
 
-    size_t memorySize() const {
-        return malloc_usable_size(data);
+    // STRING columns store their values back to back in bytes, data holds
+    // size + 1 offsets into bytes and value i spans [offsets[i], offsets[i + 1])
+    char *bytes = nullptr;
+    size_t bytesCapacity = 0;
+
+    const uint32_t * offsets() const {
+        return static_cast<const uint32_t *>(data);
+    }
+
+    const char * stringAt(size_t i) const {
+        return bytes + offsets()[i];
+    }
+
+    size_t stringLength(size_t i) const {
+        return offsets()[i + 1] - offsets()[i];
     }
 };
 
 struct ColumnarTableChunk {
     std::vector<ColumnChunk> columns;
 
-    ColumnarTableChunk(const std::vector<ColumnChunk> &columns)
-    :   columns(columns)
+    // single allocation that holds every column buffer, freed with the chunk
+    // unless it is owned elsewhere, e.g. by a ChunkPool
+    void *arena;
+    size_t arenaSize;
+    bool ownsArena;
+
+    ColumnarTableChunk(
+        const std::vector<ColumnChunk> &columns,
+        void *arena,
+        size_t arenaSize,
+        bool ownsArena = true
+    ):  columns(columns),
+        arena(arena),
+        arenaSize(arenaSize),
+        ownsArena(ownsArena)
     { }
 
     ColumnarTableChunk(const ColumnarTableChunk &) = delete;
@@ -41,17 +68,7 @@ struct ColumnarTableChunk {
     ColumnarTableChunk(ColumnarTableChunk &&) = delete;
 
     ~ColumnarTableChunk() {
-        for (auto &c : columns) {
-            switch (c.type) {
-            case DataType::STRING:
-                free(static_cast<char **>(c.data)[0]);
-                free(static_cast<char **>(c.data));
-                break;
-
-            default:
-                free(c.data);
-            }
-        }
+        if (ownsArena) free(arena);
     }
 
     ColumnarTableChunk & operator=(const ColumnarTableChunk &) = delete;
@@ -67,11 +84,6 @@ struct ColumnarTableChunk {
     }
 
     size_t memorySize() const {
-        size_t s = 0;
-        for (const auto &c : columns) {
-            s += c.memorySize();
-        }
-        return s;
+        return arenaSize;
     }
 };
- 
\ No newline at end of file
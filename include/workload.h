@@ -0,0 +1,55 @@
+#pragma once
+
+#include <query_template.h>
+#include <random.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * A named group of statements run as one transaction.
+ */
+struct Transaction {
+    std::string name;
+    uint64_t weight;
+    std::vector<QueryTemplate> statements;
+};
+
+/**
+ * A mix of transactions, each picked for a run with a probability in
+ * proportion to its weight, as in TPC-C or the sysbench OLTP tests. A
+ * workload file lists the transactions, each starting with a line
+ *
+ *   @transaction NAME WEIGHT
+ *
+ * followed by its statements, written as in query files: each ends with a
+ * semicolon, lines starting with -- are comments, and values may be
+ * generated with the placeholders of QueryTemplate. A transaction of
+ * weight 0 is never picked.
+ */
+class Workload {
+
+private:
+
+    std::vector<Transaction> _transactions;
+
+    // running totals of the weights, for picking by a single draw
+    std::vector<uint64_t> _cumulative;
+
+public:
+
+    /**
+     * Reads the workload file at path, reading choice files through files.
+     * Throws if the file is malformed.
+     */
+    Workload(const char *path, QueryTemplate::ChoiceFiles &files);
+
+    const std::vector<Transaction> & transactions() const {
+        return _transactions;
+    }
+
+    /**
+     * Picks the index of the next transaction to run.
+     */
+    size_t pick(Random &random) const;
+};
@@ -0,0 +1,227 @@
+#include <async_mysql_database.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#ifdef HAVE_MYSQL_NONBLOCKING
+
+#define MAX_EVENTS 256
+
+// the client library does not say whether a call that is not ready waits to
+// read or to write, so sockets are polled for reads, and a connection in
+// progress that has not been advanced for this many milliseconds is retried,
+// which moves along the ones stuck on a write or a connect however busy the
+// others keep the epoll set
+#define RETRY_TIMEOUT 1
+
+// the socket of a connection, or -1 while it has none; the client library
+// has no accessor for it, so it is read from the public NET struct, which
+// only holds a socket once the connection has a Vio
+static int socketOf(const MYSQL *m) {
+    return m->net.vio == nullptr ? -1 : (int) m->net.fd;
+}
+
+AsyncMySQLDatabase::AsyncMySQLDatabase(
+    const char *host,
+    const char *user,
+    const char *password,
+    const char *db,
+    unsigned int port,
+    size_t size
+):  _host(host),
+    _user(user),
+    _password(password),
+    _db(db),
+    _port(port),
+    _size(size),
+    _connections(new Connection[size])
+{
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll < 0) {
+        throw DynamicMessageError(strerror(errno));
+    }
+
+    for (size_t i = 0; i < _size; ++i) {
+        if (! mysql_init(&_connections[i].mysql)) {
+            for (size_t j = 0; j < i; ++j) mysql_close(&_connections[j].mysql);
+            close(_epoll);
+            throw RuntimeError("Insufficient memory");
+        }
+    }
+
+    _busy = _size;
+    for (size_t i = 0; i < _size; ++i) _advance(i);
+
+    while (_busy > 0) _wait(RETRY_TIMEOUT);
+
+    for (size_t i = 0; i < _size; ++i) {
+        auto &c = _connections[i];
+        if (c.state == State::RETIRED) {
+            auto e = DynamicMessageError(mysql_error(&c.mysql));
+            for (size_t j = 0; j < _size; ++j) mysql_close(&_connections[j].mysql);
+            close(_epoll);
+            throw e;
+        }
+    }
+}
+
+AsyncMySQLDatabase::~AsyncMySQLDatabase() {
+    for (size_t i = 0; i < _size; ++i) mysql_close(&_connections[i].mysql);
+    close(_epoll);
+}
+
+void AsyncMySQLDatabase::_poll(size_t index) {
+    auto &c = _connections[index];
+    int fd = socketOf(&c.mysql);
+    if (c.polled || fd < 0) return;
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = index;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) == 0) {
+        c.polled = true;
+        c.fd = fd;
+    }
+}
+
+void AsyncMySQLDatabase::_unpoll(size_t index) {
+    auto &c = _connections[index];
+    if (! c.polled) return;
+
+    // an idle socket can turn readable, e.g. when the server closes it,
+    // which would wake every wait until the run ends
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+    c.polled = false;
+}
+
+void AsyncMySQLDatabase::_wait(size_t timeout) {
+    epoll_event events[MAX_EVENTS];
+
+    int n = epoll_wait(_epoll, events, MAX_EVENTS, timeout);
+    for (int i = 0; i < n; ++i) _advance(events[i].data.u64);
+
+    auto stalled = Clock::now() - std::chrono::milliseconds(timeout);
+    for (size_t i = 0; i < _size; ++i) {
+        const auto &c = _connections[i];
+        if (c.state != State::IDLE && c.state != State::RETIRED && c.progress <= stalled) {
+            _advance(i);
+        }
+    }
+}
+
+void AsyncMySQLDatabase::_advance(size_t index) {
+    auto &c = _connections[index];
+    auto m = &c.mysql;
+    c.progress = Clock::now();
+
+    for (;;) {
+        net_async_status status;
+
+        switch (c.state) {
+        case State::CONNECTING:
+            status = mysql_real_connect_nonblocking(
+                m, _host, _user, _password, _db, _port, NULL, 0
+            );
+            _poll(index);
+            if (status == NET_ASYNC_NOT_READY) return;
+
+            --_busy;
+            c.state = status == NET_ASYNC_ERROR ? State::RETIRED : State::IDLE;
+            _unpoll(index);
+            return;
+
+        case State::QUERYING:
+            status = mysql_real_query_nonblocking(m, c.sql, strlen(c.sql));
+            if (status == NET_ASYNC_NOT_READY) return;
+            if (status == NET_ASYNC_ERROR) {
+                _complete(index, mysql_error(m));
+                break;
+            }
+
+            c.state = State::STORING;
+            break;
+
+        case State::STORING:
+            status = mysql_store_result_nonblocking(m, &c.result);
+            if (status == NET_ASYNC_NOT_READY) return;
+            if (status == NET_ASYNC_ERROR
+                || (c.result == nullptr && mysql_field_count(m) != 0)
+            ) {
+                _complete(index, mysql_error(m));
+                break;
+            }
+
+            if (c.result == nullptr) {
+                _complete(index, nullptr);
+                break;
+            }
+
+            c.state = State::FREEING;
+            break;
+
+        case State::FREEING:
+            status = mysql_free_result_nonblocking(c.result);
+            if (status == NET_ASYNC_NOT_READY) return;
+
+            c.result = nullptr;
+            _complete(index, nullptr);
+            break;
+
+        case State::IDLE:
+        case State::RETIRED:
+            return;
+        }
+    }
+}
+
+void AsyncMySQLDatabase::_complete(size_t index, const char *error) {
+    auto &c = _connections[index];
+
+    uint64_t ns = std::chrono::nanoseconds(Clock::now() - c.start).count();
+    (*_done)(index, ns, error);
+
+    --_busy;
+    c.state = State::IDLE;
+    _startNext(index);
+}
+
+void AsyncMySQLDatabase::_startNext(size_t index) {
+    auto &c = _connections[index];
+
+    c.sql = (*_next)(index);
+    if (c.sql == nullptr) {
+        c.state = State::RETIRED;
+        _unpoll(index);
+        return;
+    }
+
+    ++_busy;
+    c.state = State::QUERYING;
+    c.start = Clock::now();
+    _poll(index);
+}
+
+void AsyncMySQLDatabase::run(const NextQuery &next, const QueryDone &done) {
+    _next = &next;
+    _done = &done;
+
+    for (size_t i = 0; i < _size; ++i) {
+        if (_connections[i].state != State::IDLE) continue;
+
+        _startNext(i);
+        _advance(i);
+    }
+
+    while (_busy > 0) _wait(RETRY_TIMEOUT);
+
+    // connections that retired take part in the next run
+    for (size_t i = 0; i < _size; ++i) {
+        if (_connections[i].state == State::RETIRED) _connections[i].state = State::IDLE;
+    }
+
+    _next = nullptr;
+    _done = nullptr;
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include <chunk_pool.h>
+#include <exception.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace spl;
+
+#define COLUMN_ALIGNMENT ((size_t) 64)
+#define HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+static size_t align(size_t n, size_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+static size_t columnSize(const CSVOptions &options, const CSVField &field, size_t rows) {
+    switch (field.type) {
+    case DataType::STRING:
+        return align((rows + 1) * sizeof(uint32_t), COLUMN_ALIGNMENT)
+            + CSV::stringCapacity(options, field, rows);
+
+    default:
+        return rows * CSV::fieldSize(field);
+    }
+}
+
+size_t ChunkPool::arenaSize(const CSVOptions &options, size_t rows) {
+    size_t sz = 0;
+    for (const auto &f : options.fields) {
+        sz += align(columnSize(options, f, rows), COLUMN_ALIGNMENT);
+    }
+    return sz;
+}
+
+std::vector<ColumnChunk> ChunkPool::carve(
+    const CSVOptions &options,
+    size_t rows,
+    void *arena
+) {
+    const auto &fields = options.fields;
+    std::vector<ColumnChunk> columns(fields.size());
+    char *p = static_cast<char *>(arena);
+
+    for (size_t i = 0; i < fields.size(); ++i) {
+        columns[i] = { fields[i].type, p, rows };
+
+        if (fields[i].type == DataType::STRING) {
+            static_cast<uint32_t *>(columns[i].data)[0] = 0;
+            columns[i].bytes = p + align((rows + 1) * sizeof(uint32_t), COLUMN_ALIGNMENT);
+            columns[i].bytesCapacity = CSV::stringCapacity(options, fields[i], rows);
+        }
+
+        p += align(columnSize(options, fields[i], rows), COLUMN_ALIGNMENT);
+    }
+
+    return columns;
+}
+
+ChunkPool::ChunkPool(
+    const CSVOptions &options,
+    size_t rows,
+    size_t capacity,
+    bool hugePages
+):  _options(options),
+    _rows(rows),
+    _capacity(capacity == 0 ? 1 : capacity),
+    _hugePages(hugePages)
+{
+    _arenaSize = align(
+        arenaSize(options, rows),
+        hugePages ? HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE)
+    );
+}
+
+ChunkPool::~ChunkPool() {
+    for (auto c : _all) {
+        munmap(c->arena, c->arenaSize);
+        delete c;
+    }
+}
+
+void * ChunkPool::_allocateArena() {
+    void *arena = MAP_FAILED;
+
+    if (_hugePages) {
+        arena = mmap(
+            nullptr,
+            _arenaSize,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+            -1,
+            0
+        );
+    }
+
+    if (arena == MAP_FAILED) {
+        arena = mmap(
+            nullptr,
+            _arenaSize,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0
+        );
+        if (arena == MAP_FAILED) {
+            throw RuntimeError("Insufficient memory");
+        }
+
+        // no reserved huge pages, fall back to transparent huge pages
+        if (_hugePages) madvise(arena, _arenaSize, MADV_HUGEPAGE);
+    }
+
+    return arena;
+}
+
+ColumnarTableChunk * ChunkPool::acquire() {
+    std::unique_lock lk(_mtx);
+
+    if (_free.empty() && _all.size() < _capacity) {
+        auto arena = _allocateArena();
+        auto chunk = new ColumnarTableChunk(
+            carve(_options, _rows, arena),
+            arena,
+            _arenaSize,
+            false
+        );
+        _all.push_back(chunk);
+        return chunk;
+    }
+
+    if (_free.empty()) ++_waits;
+    _available.wait(lk, [this] { return ! _free.empty(); });
+
+    auto chunk = _free.back();
+    _free.pop_back();
+
+    for (auto &c : chunk->columns) {
+        c.size = _rows;
+    }
+
+    return chunk;
+}
+
+void ChunkPool::release(ColumnarTableChunk *chunk) {
+    {
+        std::unique_lock lk(_mtx);
+        _free.push_back(chunk);
+    }
+    _available.notify_one();
+}
@@ -0,0 +1,258 @@
+#include <chunk_sorter.h>
+#include <spec_parser.h>
+#include <mysql.h>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace spl;
+
+#define COLUMN_ALIGNMENT ((size_t) 64)
+
+static void fail(const char *spec, const char *reason) {
+    SpecParser::fail("sort key", spec, reason);
+}
+
+static size_t align(size_t n, size_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+ChunkSorter::Buffer::~Buffer() {
+    free(_arena);
+}
+
+ChunkSorter::ChunkSorter(const char *spec, const std::vector<CSVField> &fields)
+:   _fields(fields)
+{
+    for (const auto &part : SpecParser::split(spec, ',')) {
+        int64_t column;
+        if (! SpecParser::parseInteger(part, column)) fail(spec, "expected COLUMN[,COLUMN...]");
+        if (column < 1 || (size_t) column > fields.size()) fail(spec, "no such column");
+        if (std::find(_keys.begin(), _keys.end(), column - 1) != _keys.end()) fail(spec, "column given twice");
+
+        _keys.push_back(column - 1);
+    }
+}
+
+// maps values to unsigned integers in the same order: signed values get
+// their sign bit flipped, and floats their sign bit if they are positive or
+// every bit if they are negative
+template <typename T>
+static inline uint64_t orderedKey(T value) {
+    if constexpr (std::is_unsigned_v<T>) {
+        return value;
+    }
+    else {
+        return (uint64_t) (int64_t) value ^ ((uint64_t) 1 << 63);
+    }
+}
+
+static inline uint64_t orderedKey(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return bits ^ ((uint32_t) ((int32_t) bits >> 31) | 0x80000000u);
+}
+
+static inline uint64_t orderedKey(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return bits ^ ((uint64_t) ((int64_t) bits >> 63) | ((uint64_t) 1 << 63));
+}
+
+static inline uint64_t orderedKey(const MYSQL_TIME &t) {
+    // 14 bits of year, 4 of month, 5 of day, hour and 6 each of minute and
+    // second leave 20 bits for the microseconds
+    return (uint64_t) t.year << 46
+        | (uint64_t) t.month << 42
+        | (uint64_t) t.day << 37
+        | (uint64_t) t.hour << 32
+        | (uint64_t) t.minute << 26
+        | (uint64_t) t.second << 20
+        | (uint64_t) t.second_part;
+}
+
+template <typename T>
+static void extractKeys(const void *data, const uint32_t *order, size_t n, uint64_t *keys) {
+    auto values = static_cast<const T *>(data);
+    for (size_t i = 0; i < n; ++i) keys[i] = orderedKey(values[order[i]]);
+}
+
+void ChunkSorter::_radixSort(Buffer &buffer, size_t n) const {
+    auto &keys = buffer._keys;
+    auto &order = buffer._order;
+    buffer._keysTmp.resize(n);
+    buffer._orderTmp.resize(n);
+
+    // the counts of every byte are taken in a single pass, and a byte that
+    // is the same in every key, like the high bytes of small ids, costs
+    // nothing more
+    size_t counts[8][256] = { };
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t k = keys[i];
+        for (size_t d = 0; d < 8; ++d) ++counts[d][(k >> (8 * d)) & 0xff];
+    }
+
+    for (size_t d = 0; d < 8; ++d) {
+        size_t shift = 8 * d;
+        if (counts[d][(keys[0] >> shift) & 0xff] == n) continue;
+
+        size_t pos[256];
+        size_t sum = 0;
+        for (size_t b = 0; b < 256; ++b) {
+            pos[b] = sum;
+            sum += counts[d][b];
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            size_t p = pos[(keys[i] >> shift) & 0xff]++;
+            buffer._keysTmp[p] = keys[i];
+            buffer._orderTmp[p] = order[i];
+        }
+
+        keys.swap(buffer._keysTmp);
+        order.swap(buffer._orderTmp);
+    }
+}
+
+// by bytes, as a binary collation orders them; the server's collation is not
+// known here
+void ChunkSorter::_sortStrings(const ColumnChunk &column, Buffer &buffer) const {
+    std::stable_sort(buffer._order.begin(), buffer._order.end(), [&](uint32_t a, uint32_t b) {
+        size_t lenA = column.stringLength(a), lenB = column.stringLength(b);
+        int c = memcmp(column.stringAt(a), column.stringAt(b), std::min(lenA, lenB));
+        return c < 0 || (c == 0 && lenA < lenB);
+    });
+}
+
+ColumnarTableChunk * ChunkSorter::_gather(const ColumnarTableChunk *chunk, Buffer &buffer) const {
+    size_t n = chunk->size();
+
+    // the buffer is laid out like a pooled chunk with exactly the room the
+    // strings of this one need
+    size_t size = 0;
+    for (size_t j = 0; j < _fields.size(); ++j) {
+        if (_fields[j].type == DataType::STRING) {
+            const auto &c = chunk->columns[j];
+            size += align((n + 1) * sizeof(uint32_t), COLUMN_ALIGNMENT)
+                + align(c.offsets()[n] - c.offsets()[0], COLUMN_ALIGNMENT);
+        }
+        else {
+            size += align(n * CSV::fieldSize(_fields[j]), COLUMN_ALIGNMENT);
+        }
+    }
+
+    if (size > buffer._arenaSize) {
+        free(buffer._arena);
+        buffer._arena = aligned_alloc(COLUMN_ALIGNMENT, size);
+        if (buffer._arena == nullptr) {
+            buffer._arenaSize = 0;
+            throw RuntimeError("Out of memory for a sort buffer");
+        }
+        buffer._arenaSize = size;
+    }
+
+    std::vector<ColumnChunk> columns(_fields.size());
+    char *p = static_cast<char *>(buffer._arena);
+    for (size_t j = 0; j < _fields.size(); ++j) {
+        auto &c = columns[j];
+        c.type = _fields[j].type;
+        c.data = p;
+        c.size = n;
+
+        if (c.type == DataType::STRING) {
+            const auto &src = chunk->columns[j];
+            static_cast<uint32_t *>(c.data)[0] = 0;
+            c.bytes = p + align((n + 1) * sizeof(uint32_t), COLUMN_ALIGNMENT);
+            c.bytesCapacity = src.offsets()[n] - src.offsets()[0];
+            p = c.bytes + align(c.bytesCapacity, COLUMN_ALIGNMENT);
+        }
+        else {
+            p += align(n * CSV::fieldSize(_fields[j]), COLUMN_ALIGNMENT);
+        }
+    }
+
+    buffer._chunk.reset(new ColumnarTableChunk(columns, buffer._arena, buffer._arenaSize, false));
+    CSV::gather(_fields, buffer._chunk.get(), 0, n, chunk, buffer._order.data(), n);
+
+    return buffer._chunk.get();
+}
+
+const ColumnarTableChunk * ChunkSorter::sort(const ColumnarTableChunk *chunk, Buffer &buffer) const {
+    size_t n = chunk->size();
+    if (n < 2) return chunk;
+
+    auto &order = buffer._order;
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    buffer._keys.resize(n);
+
+    // a stable sort by each key column, least significant first, leaves the
+    // rows in the order of the whole key
+    for (auto k = _keys.rbegin(); k != _keys.rend(); ++k) {
+        const auto &column = chunk->columns[*k];
+        auto keys = buffer._keys.data();
+
+        switch (column.type) {
+        case DataType::UINT8:
+            extractKeys<uint8_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::UINT16:
+            extractKeys<uint16_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::UINT32:
+            extractKeys<uint32_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::UINT64:
+            extractKeys<uint64_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::INT8:
+            extractKeys<int8_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::INT16:
+            extractKeys<int16_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::INT32:
+            extractKeys<int32_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::INT64:
+            extractKeys<int64_t>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::FLOAT32:
+            extractKeys<float>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::FLOAT64:
+            extractKeys<double>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::MYSQL_DATE:
+        case DataType::MYSQL_DATETIME:
+            extractKeys<MYSQL_TIME>(column.data, order.data(), n, keys);
+            break;
+
+        case DataType::STRING:
+            _sortStrings(column, buffer);
+            continue;
+        }
+
+        _radixSort(buffer, n);
+    }
+
+    // rows that are in order already, as when the file was written in key
+    // order, are loaded as they are
+    bool sorted = true;
+    for (size_t i = 0; i < n && sorted; ++i) sorted = order[i] == i;
+    if (sorted) return chunk;
+
+    return _gather(chunk, buffer);
+}
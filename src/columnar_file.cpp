@@ -0,0 +1,302 @@
+#include <columnar_file.h>
+#include <exception.h>
+#include <mysql.h>
+#include <sstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace spl;
+
+#define MAGIC "DBLGCOL1"
+#define VERSION 1
+#define BUFFER_ALIGNMENT ((uint64_t) 64)
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+
+    // layouts that differ between platforms and client library versions
+    uint32_t timeSize;
+    uint32_t reserved;
+};
+
+struct ColumnHeader {
+    uint32_t type;
+    uint32_t size;
+};
+
+struct FileFooter {
+    uint64_t indexOffset;
+    uint64_t chunks;
+    uint64_t rows;
+    char magic[8];
+};
+
+// an index entry holds the rows, begin and end offsets of a chunk, followed
+// by the offsets of the data and string bytes of each of its columns
+static size_t indexEntrySize(size_t columns) {
+    return 3 + 2 * columns;
+}
+
+// whether the size bytes at offset lie within [begin, end)
+static bool within(uint64_t offset, uint64_t size, uint64_t begin, uint64_t end) {
+    return offset >= begin && offset <= end && size <= end - offset;
+}
+
+static void fail(const std::string &path, const char *reason) {
+    std::stringstream msg;
+    msg << path << ": " << reason;
+    throw DynamicMessageError(msg.str().c_str());
+}
+
+ColumnarFileWriter::ColumnarFileWriter(const char *path, const std::vector<CSVField> &fields)
+:   _path(path),
+    _fields(fields)
+{
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) fail(_path, strerror(errno));
+
+    FileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.columns = fields.size();
+    header.timeSize = sizeof(MYSQL_TIME);
+    header.reserved = 0;
+    _write(&header, sizeof(header));
+
+    for (const auto &f : fields) {
+        ColumnHeader column = { (uint32_t) f.type, (uint32_t) f.size };
+        _write(&column, sizeof(column));
+    }
+}
+
+ColumnarFileWriter::~ColumnarFileWriter() {
+    if (_fd >= 0) ::close(_fd);
+}
+
+void ColumnarFileWriter::_write(const void *data, size_t size) {
+    auto p = static_cast<const char *>(data);
+
+    while (size > 0) {
+        ssize_t n = ::write(_fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail(_path, strerror(errno));
+        }
+
+        p += n;
+        size -= n;
+        _offset += n;
+    }
+}
+
+void ColumnarFileWriter::_align() {
+    static const char zeros[BUFFER_ALIGNMENT] = { };
+
+    size_t padding = (BUFFER_ALIGNMENT - _offset % BUFFER_ALIGNMENT) % BUFFER_ALIGNMENT;
+    _write(zeros, padding);
+}
+
+void ColumnarFileWriter::write(const ColumnarTableChunk *chunk) {
+    size_t rows = chunk->size();
+    if (rows == 0) return;
+
+    _align();
+
+    size_t entry = _index.size();
+    _index.resize(entry + indexEntrySize(_fields.size()));
+    _index[entry] = rows;
+    _index[entry + 1] = _offset;
+
+    for (size_t j = 0; j < _fields.size(); ++j) {
+        const auto &c = chunk->columns[j];
+        uint64_t *offsets = &_index[entry + 3 + 2 * j];
+
+        _align();
+        offsets[0] = _offset;
+
+        if (c.type == DataType::STRING) {
+            _write(c.data, (rows + 1) * sizeof(uint32_t));
+
+            _align();
+            offsets[1] = _offset;
+            _write(c.bytes, c.offsets()[rows]);
+        }
+        else {
+            _write(c.data, rows * CSV::fieldSize(_fields[j]));
+            offsets[1] = 0;
+        }
+    }
+
+    _index[entry + 2] = _offset;
+
+    _rows += rows;
+    ++_chunks;
+}
+
+void ColumnarFileWriter::close() {
+    if (_fd < 0) return;
+
+    _align();
+
+    FileFooter footer;
+    footer.indexOffset = _offset;
+    footer.chunks = _chunks;
+    footer.rows = _rows;
+    memcpy(footer.magic, MAGIC, sizeof(footer.magic));
+
+    _write(_index.data(), _index.size() * sizeof(uint64_t));
+    _write(&footer, sizeof(footer));
+
+    if (::close(_fd) != 0) {
+        _fd = -1;
+        fail(_path, strerror(errno));
+    }
+    _fd = -1;
+}
+
+ColumnarFile::ColumnarFile(const char *path)
+:   _path(path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) fail(_path, strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        fail(_path, strerror(errno));
+    }
+    _length = st.st_size;
+
+    if (_length < sizeof(FileHeader) + sizeof(FileFooter)) {
+        ::close(fd);
+        fail(_path, "not a columnar snapshot");
+    }
+
+    _map = mmap(nullptr, _length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (_map == MAP_FAILED) {
+        _map = nullptr;
+        fail(_path, strerror(errno));
+    }
+
+    // chunks are loaded front to back
+    madvise(_map, _length, MADV_SEQUENTIAL);
+
+    try {
+        auto base = static_cast<const char *>(_map);
+
+        FileHeader header;
+        memcpy(&header, base, sizeof(header));
+        FileFooter footer;
+        memcpy(&footer, base + _length - sizeof(footer), sizeof(footer));
+
+        if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0
+            || memcmp(footer.magic, MAGIC, sizeof(footer.magic)) != 0
+        ) {
+            fail(_path, "not a columnar snapshot, or an incomplete one");
+        }
+        if (header.version != VERSION || header.timeSize != sizeof(MYSQL_TIME)) {
+            fail(_path, "snapshot written by an incompatible version");
+        }
+
+        size_t columnsEnd = sizeof(header) + header.columns * sizeof(ColumnHeader);
+        if (header.columns == 0 || columnsEnd > _length) fail(_path, "damaged header");
+
+        for (size_t j = 0; j < header.columns; ++j) {
+            ColumnHeader column;
+            memcpy(&column, base + sizeof(header) + j * sizeof(column), sizeof(column));
+            if (column.type > (uint32_t) DataType::MYSQL_DATETIME) fail(_path, "damaged header");
+
+            _fields.push_back(CSVField((DataType) column.type, column.size));
+        }
+
+        // divided rather than multiplied, so that no count can overflow
+        size_t entry = indexEntrySize(_fields.size());
+        size_t indexEnd = _length - sizeof(footer);
+        if (footer.indexOffset % BUFFER_ALIGNMENT != 0
+            || footer.indexOffset > indexEnd
+            || (indexEnd - footer.indexOffset) % (entry * sizeof(uint64_t)) != 0
+            || footer.chunks != (indexEnd - footer.indexOffset) / (entry * sizeof(uint64_t))
+        ) {
+            fail(_path, "damaged chunk index");
+        }
+
+        _index = reinterpret_cast<const uint64_t *>(base + footer.indexOffset);
+        _chunks = footer.chunks;
+        _rows = footer.rows;
+
+        // every chunk has to lie before the index, every buffer within its
+        // chunk, and the rows of the chunks have to add up to the total
+        uint64_t total = 0;
+        for (size_t i = 0; i < _chunks; ++i) {
+            const uint64_t *e = _index + i * entry;
+            if (e[1] > e[2] || e[2] > footer.indexOffset) fail(_path, "damaged chunk index");
+
+            uint64_t rows = e[0];
+            if (__builtin_add_overflow(total, rows, &total)) fail(_path, "damaged chunk index");
+
+            for (size_t j = 0; j < _fields.size(); ++j) {
+                uint64_t data = e[3 + 2 * j];
+                if (data % BUFFER_ALIGNMENT != 0) fail(_path, "damaged chunk index");
+
+                if (_fields[j].type == DataType::STRING) {
+                    if (rows >= (e[2] - e[1]) / sizeof(uint32_t)
+                        || ! within(data, (rows + 1) * sizeof(uint32_t), e[1], e[2])
+                    ) {
+                        fail(_path, "damaged chunk index");
+                    }
+
+                    auto offsets = reinterpret_cast<const uint32_t *>(base + data);
+                    for (size_t r = 0; r < rows; ++r) {
+                        if (offsets[r] > offsets[r + 1]) fail(_path, "damaged string column");
+                    }
+                    if (! within(e[4 + 2 * j], offsets[rows], e[1], e[2])) {
+                        fail(_path, "damaged string column");
+                    }
+                }
+                else {
+                    size_t size = CSV::fieldSize(_fields[j]);
+                    if (rows > (e[2] - e[1]) / size || ! within(data, rows * size, e[1], e[2])) {
+                        fail(_path, "damaged chunk index");
+                    }
+                }
+            }
+        }
+        if (total != _rows) fail(_path, "damaged chunk index");
+    }
+    catch (...) {
+        munmap(_map, _length);
+        throw;
+    }
+}
+
+ColumnarFile::~ColumnarFile() {
+    if (_map != nullptr) munmap(_map, _length);
+}
+
+ColumnarTableChunk * ColumnarFile::chunk(size_t i) const {
+    auto base = static_cast<char *>(_map);
+    const uint64_t *e = _index + i * indexEntrySize(_fields.size());
+    size_t rows = e[0];
+
+    std::vector<ColumnChunk> columns(_fields.size());
+    for (size_t j = 0; j < _fields.size(); ++j) {
+        auto &c = columns[j];
+        c.type = _fields[j].type;
+        c.data = base + e[3 + 2 * j];
+        c.size = rows;
+
+        if (c.type == DataType::STRING) {
+            c.bytes = base + e[4 + 2 * j];
+            c.bytesCapacity = c.offsets()[rows];
+        }
+    }
+
+    return new ColumnarTableChunk(columns, base + e[1], e[2] - e[1], false);
+}
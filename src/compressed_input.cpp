@@ -0,0 +1,354 @@
+#include <compressed_input.h>
+#include <exception.h>
+#include <algorithm>
+#include <sstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+using namespace spl;
+
+static void fail(const std::string &path, const char *reason) {
+    std::stringstream msg;
+    msg << path << ": " << reason;
+    throw DynamicMessageError(msg.str().c_str());
+}
+
+static bool endsWith(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+Compression CompressedInput::detect(const char *path) {
+    if (endsWith(path, ".gz")) return Compression::GZIP;
+    if (endsWith(path, ".zst")) return Compression::ZSTD;
+    if (endsWith(path, ".lz4")) return Compression::LZ4;
+    return Compression::NONE;
+}
+
+bool CompressedInput::supported(Compression compression) {
+    switch (compression) {
+    case Compression::NONE:
+        return true;
+
+    case Compression::GZIP:
+#ifdef HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+
+    case Compression::ZSTD:
+#ifdef HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+
+    case Compression::LZ4:
+#ifdef HAVE_LZ4
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+#ifdef HAVE_ZSTD
+/**
+ * Walks the frame headers of the zstd data in [p, p + length).
+ */
+static std::vector<CompressedFrame> zstdFrames(const char *p, size_t length) {
+    std::vector<CompressedFrame> frames;
+    uint64_t offset = 0, contentOffset = 0;
+
+    while (offset < length) {
+        size_t size = ZSTD_findFrameCompressedSize(p + offset, length - offset);
+        unsigned long long content = ZSTD_getFrameContentSize(p + offset, length - offset);
+        if (ZSTD_isError(size)
+            || content == ZSTD_CONTENTSIZE_UNKNOWN
+            || content == ZSTD_CONTENTSIZE_ERROR
+        ) {
+            return { };
+        }
+
+        frames.push_back({ offset, contentOffset, content });
+        offset += size;
+        contentOffset += content;
+    }
+
+    return frames;
+}
+#endif
+
+std::vector<CompressedFrame> CompressedInput::frames(const char *path) {
+#ifdef HAVE_ZSTD
+    if (detect(path) != Compression::ZSTD) return { };
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) fail(path, strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return { };
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) fail(path, strerror(errno));
+
+    auto frames = zstdFrames(static_cast<const char *>(map), st.st_size);
+    munmap(map, st.st_size);
+
+    return frames;
+#else
+    return { };
+#endif
+}
+
+CompressedInput::CompressedInput(int fd, const char *path, Compression compression, uint64_t start)
+:   _path(path),
+    _compression(compression)
+{
+    if (! supported(compression)) {
+        fail(_path, "this build cannot read files of this compression format");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) fail(_path, strerror(errno));
+    _length = st.st_size;
+
+    if (_length > 0) {
+        _map = mmap(nullptr, _length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (_map == MAP_FAILED) {
+            _map = nullptr;
+            fail(_path, strerror(errno));
+        }
+        madvise(_map, _length, MADV_SEQUENTIAL);
+    }
+
+    _in = static_cast<const char *>(_map);
+    _inEnd = _in + _length;
+    _skip = start;
+
+    switch (compression) {
+    case Compression::NONE:
+        break;
+
+    case Compression::GZIP: {
+#ifdef HAVE_ZLIB
+        auto z = new z_stream();
+        // gzip or zlib headers, detected automatically
+        if (inflateInit2(z, 15 + 32) != Z_OK) {
+            delete z;
+            munmap(_map, _length);
+            fail(_path, "cannot initialize zlib");
+        }
+        _stream = z;
+#endif
+    }
+    break;
+
+    case Compression::ZSTD: {
+#ifdef HAVE_ZSTD
+        // start at the frame that holds the start offset
+        if (start > 0) {
+            auto frames = zstdFrames(_in, _length);
+            for (const auto &f : frames) {
+                if (f.contentOffset > start) break;
+                _in = static_cast<const char *>(_map) + f.offset;
+                _skip = start - f.contentOffset;
+            }
+        }
+
+        _stream = ZSTD_createDStream();
+        if (_stream == nullptr) {
+            munmap(_map, _length);
+            fail(_path, "cannot initialize zstd");
+        }
+#endif
+    }
+    break;
+
+    case Compression::LZ4: {
+#ifdef HAVE_LZ4
+        LZ4F_dctx *ctx;
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) {
+            munmap(_map, _length);
+            fail(_path, "cannot initialize lz4");
+        }
+        _stream = ctx;
+#endif
+    }
+    break;
+    }
+}
+
+CompressedInput::~CompressedInput() {
+    switch (_compression) {
+    case Compression::NONE:
+        break;
+
+    case Compression::GZIP:
+#ifdef HAVE_ZLIB
+        inflateEnd(static_cast<z_stream *>(_stream));
+        delete static_cast<z_stream *>(_stream);
+#endif
+        break;
+
+    case Compression::ZSTD:
+#ifdef HAVE_ZSTD
+        ZSTD_freeDStream(static_cast<ZSTD_DStream *>(_stream));
+#endif
+        break;
+
+    case Compression::LZ4:
+#ifdef HAVE_LZ4
+        LZ4F_freeDecompressionContext(static_cast<LZ4F_dctx *>(_stream));
+#endif
+        break;
+    }
+
+    if (_map != nullptr) munmap(_map, _length);
+}
+
+size_t CompressedInput::_decompress(char *buf, size_t n) {
+    if (_done || n == 0) return 0;
+
+    switch (_compression) {
+    case Compression::NONE: {
+        n = std::min<size_t>(n, _inEnd - _in);
+        memcpy(buf, _in, n);
+        _in += n;
+        if (_in == _inEnd) _done = true;
+        return n;
+    }
+
+    case Compression::GZIP: {
+#ifdef HAVE_ZLIB
+        auto z = static_cast<z_stream *>(_stream);
+        z->next_out = reinterpret_cast<Bytef *>(buf);
+        z->avail_out = std::min<size_t>(n, UINT32_MAX);
+
+        while (z->avail_out > 0) {
+            if (z->avail_in == 0) {
+                if (_in == _inEnd) break;
+
+                size_t len = std::min<size_t>(_inEnd - _in, UINT32_MAX);
+                z->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(_in));
+                z->avail_in = len;
+                _in += len;
+            }
+
+            int ret = inflate(z, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // another member may follow, as pigz writes them
+                if (z->avail_in == 0 && _in == _inEnd) {
+                    _done = true;
+                    break;
+                }
+                inflateReset(z);
+            }
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                fail(_path, z->msg ? z->msg : "corrupt gzip data");
+            }
+        }
+
+        size_t produced = reinterpret_cast<char *>(z->next_out) - buf;
+        if (produced == 0 && ! _done) fail(_path, "truncated gzip data");
+        return produced;
+#else
+        return 0;
+#endif
+    }
+
+    case Compression::ZSTD: {
+#ifdef HAVE_ZSTD
+        auto ds = static_cast<ZSTD_DStream *>(_stream);
+        ZSTD_outBuffer out = { buf, n, 0 };
+        ZSTD_inBuffer in = { _in, (size_t) (_inEnd - _in), 0 };
+
+        while (out.pos < out.size && (in.pos < in.size || _inFrame)) {
+            size_t before = out.pos, consumed = in.pos;
+
+            size_t ret = ZSTD_decompressStream(ds, &out, &in);
+            if (ZSTD_isError(ret)) fail(_path, ZSTD_getErrorName(ret));
+            _inFrame = ret != 0;
+
+            if (out.pos == before && in.pos == consumed) break;
+        }
+
+        _in += in.pos;
+        if (out.pos == 0) {
+            if (_inFrame) fail(_path, "truncated zstd data");
+            _done = true;
+        }
+        return out.pos;
+#else
+        return 0;
+#endif
+    }
+
+    case Compression::LZ4: {
+#ifdef HAVE_LZ4
+        auto ctx = static_cast<LZ4F_dctx *>(_stream);
+        size_t produced = 0;
+
+        // the context keeps decoded data that did not fit, and hands it out
+        // even when there is no input left
+        while (produced < n && (_in < _inEnd || _inFrame)) {
+            size_t outSize = n - produced;
+            size_t inSize = _inEnd - _in;
+
+            size_t ret = LZ4F_decompress(ctx, buf + produced, &outSize, _in, &inSize, nullptr);
+            if (LZ4F_isError(ret)) fail(_path, LZ4F_getErrorName(ret));
+            _inFrame = ret != 0;
+
+            _in += inSize;
+            produced += outSize;
+
+            if (outSize == 0 && inSize == 0) break;
+        }
+
+        if (produced == 0) {
+            if (_inFrame) fail(_path, "truncated lz4 data");
+            _done = true;
+        }
+        return produced;
+#else
+        return 0;
+#endif
+    }
+    }
+
+    return 0;
+}
+
+size_t CompressedInput::read(char *buf, size_t n) {
+    // the caller's buffer doubles as scratch space for the skipped bytes
+    while (_skip > 0) {
+        size_t k = _decompress(buf, std::min<uint64_t>(n, _skip));
+        if (k == 0) return 0;
+        _skip -= k;
+    }
+
+    return _decompress(buf, n);
+}
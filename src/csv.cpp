@@ -1,11 +1,25 @@
 #include <csv.h>
+#include <csv_scanner.h>
+#include <compressed_input.h>
+#include <chunk_pool.h>
 #include <file.h>
-#include <string_conversions.h>
+#include <field_parser.h>
 #include <mysql.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <sstream>
 
 using namespace spl;
 
-static size_t size(const CSVField &field) {
+// bytes indexed by one call to CSVScanner::scan
+#define SCAN_WINDOW ((size_t) 64 * 1024)
+
+size_t CSV::fieldSize(const CSVField &field) {
     switch (field.type) {
     case DataType::UINT8:
     case DataType::INT8:
@@ -32,6 +46,7 @@ static size_t size(const CSVField &field) {
         break;
 
     case DataType::MYSQL_DATE:
+    case DataType::MYSQL_DATETIME:
         return sizeof(MYSQL_TIME);
         break;
     }
@@ -39,178 +54,617 @@ static size_t size(const CSVField &field) {
     return 0;
 }
 
-static size_t estimatedRowSize(const CSVOptions &options) {
-    size_t sz = 0;
+size_t CSV::stringCapacity(
+    const CSVOptions &options,
+    const CSVField &field,
+    size_t rows
+) {
+    return (size_t) (rows * field.size * options.stringFill) + field.size;
+}
 
-    for (const auto &f : options.fields) sz += size(f);
+size_t CSV::rowsPerChunk(const CSVOptions &options) {
+    double sz = 0;
 
-    return sz;
+    for (const auto &f : options.fields) {
+        if (f.type == DataType::STRING) {
+            sz += sizeof(uint32_t) + f.size * options.stringFill;
+        }
+        else {
+            sz += fieldSize(f);
+        }
+    }
+
+    return std::max<size_t>(1, options.maxChunkSize / std::max(sz, 1.0));
+}
+
+// values are copied as bytes, whatever their type; a copy of a constant size
+// compiles to a single move
+template <size_t SIZE>
+static void gatherValues(void *dst, const void *src, const uint32_t *rows, size_t n) {
+    auto d = static_cast<char *>(dst);
+    auto s = static_cast<const char *>(src);
+    for (size_t i = 0; i < n; ++i) memcpy(d + i * SIZE, s + rows[i] * SIZE, SIZE);
 }
 
-static std::vector<ColumnChunk> allocateColumns(const CSVOptions &options, size_t length) {
-    std::vector<ColumnChunk> columns(options.fields.size());
+size_t CSV::gather(
+    const std::vector<CSVField> &fields,
+    ColumnarTableChunk *dst,
+    size_t dstRows,
+    size_t capacity,
+    const ColumnarTableChunk *src,
+    const uint32_t *rows,
+    size_t n
+) {
+    n = std::min(n, capacity - dstRows);
+
+    // the rows whose strings all fit are found before anything is copied
+    for (size_t j = 0; j < fields.size(); ++j) {
+        if (fields[j].type != DataType::STRING) continue;
 
-    for (size_t i = 0; i < options.fields.size(); ++i) {
-        switch (options.fields[i].type) {
-        case DataType::STRING: {
-            auto width = size(options.fields[i]) + 1;
-            char *buf = (char *) calloc(length, width);
-            char **ptr = (char **) calloc(length, sizeof(char *));
-            char **pp = ptr;
-            for (auto p = buf; p != buf + length * width; p += width, ++pp) {
-                *pp = p;
+        const auto &d = dst->columns[j];
+        const auto &s = src->columns[j];
+        size_t room = d.bytesCapacity - d.offsets()[dstRows];
+
+        size_t fit = 0, bytes = 0;
+        while (fit < n && (bytes += s.stringLength(rows[fit])) <= room) ++fit;
+        n = fit;
+    }
+
+    for (size_t j = 0; j < fields.size(); ++j) {
+        auto &d = dst->columns[j];
+        const auto &s = src->columns[j];
+
+        if (fields[j].type == DataType::STRING) {
+            auto offsets = static_cast<uint32_t *>(d.data);
+            uint32_t pos = offsets[dstRows];
+
+            for (size_t i = 0; i < n; ++i) {
+                size_t len = s.stringLength(rows[i]);
+                memcpy(d.bytes + pos, s.stringAt(rows[i]), len);
+                pos += len;
+                offsets[dstRows + i + 1] = pos;
             }
-            columns[i] = {
-                options.fields[i].type,
-                ptr,
-                length
-            };
+            continue;
         }
-        break;
+
+        size_t size = fieldSize(fields[j]);
+        void *out = static_cast<char *>(d.data) + dstRows * size;
+
+        switch (size) {
+        case 1:
+            gatherValues<1>(out, s.data, rows, n);
+            break;
+
+        case 2:
+            gatherValues<2>(out, s.data, rows, n);
+            break;
+
+        case 4:
+            gatherValues<4>(out, s.data, rows, n);
+            break;
+
+        case 8:
+            gatherValues<8>(out, s.data, rows, n);
+            break;
 
         default:
-            columns[i] = {
-                options.fields[i].type,
-                calloc(length, size(options.fields[i])),
-                length
-            };
+            for (size_t i = 0; i < n; ++i) {
+                memcpy(
+                    static_cast<char *>(out) + i * size,
+                    static_cast<const char *>(s.data) + rows[i] * size,
+                    size
+                );
+            }
+            break;
         }
     }
 
-    return columns;
+    return n;
 }
 
-std::vector<ColumnarTableChunk *> CSV::read(
+static ColumnarTableChunk * allocateChunk(const CSVOptions &options, size_t rows) {
+    size_t sz = ChunkPool::arenaSize(options, rows);
+    void *arena = malloc(sz);
+    if (arena == nullptr) {
+        throw RuntimeError("Insufficient memory");
+    }
+
+    return new ColumnarTableChunk(
+        ChunkPool::carve(options, rows, arena),
+        arena,
+        sz
+    );
+}
+
+static const char * typeName(DataType type) {
+    switch (type) {
+    case DataType::UINT8: return "uint8";
+    case DataType::UINT16: return "uint16";
+    case DataType::UINT32: return "uint32";
+    case DataType::UINT64: return "uint64";
+    case DataType::INT8: return "int8";
+    case DataType::INT16: return "int16";
+    case DataType::INT32: return "int32";
+    case DataType::INT64: return "int64";
+    case DataType::FLOAT32: return "float32";
+    case DataType::FLOAT64: return "float64";
+    case DataType::STRING: return "string";
+    case DataType::MYSQL_DATE: return "mysql_date";
+    case DataType::MYSQL_DATETIME: return "mysql_datetime";
+    }
+
+    return "unknown";
+}
+
+static inline bool convertField(
+    const char *p,
+    const char *end,
+    const CSVField &field,
+    ColumnChunk &column,
+    size_t row
+) {
+    switch (field.type) {
+    case DataType::UINT8:
+        return FieldParser::parseUnsigned(p, end, static_cast<uint8 *>(column.data)[row]);
+
+    case DataType::UINT16:
+        return FieldParser::parseUnsigned(p, end, static_cast<uint16 *>(column.data)[row]);
+
+    case DataType::UINT32:
+        return FieldParser::parseUnsigned(p, end, static_cast<uint32 *>(column.data)[row]);
+
+    case DataType::UINT64:
+        return FieldParser::parseUnsigned(p, end, static_cast<uint64 *>(column.data)[row]);
+
+    case DataType::INT8:
+        return FieldParser::parseSigned(p, end, static_cast<int8 *>(column.data)[row]);
+
+    case DataType::INT16:
+        return FieldParser::parseSigned(p, end, static_cast<int16 *>(column.data)[row]);
+
+    case DataType::INT32:
+        return FieldParser::parseSigned(p, end, static_cast<int32 *>(column.data)[row]);
+
+    case DataType::INT64:
+        return FieldParser::parseSigned(p, end, static_cast<int64 *>(column.data)[row]);
+
+    case DataType::FLOAT32:
+        return FieldParser::parseFloat(p, end, static_cast<float32 *>(column.data)[row]);
+
+    case DataType::FLOAT64:
+        return FieldParser::parseFloat(p, end, static_cast<float64 *>(column.data)[row]);
+
+    case DataType::STRING: {
+        // values longer than the declared size are truncated, which is what
+        // lets the reader check for room before parsing a row
+        auto offsets = static_cast<uint32_t *>(column.data);
+        size_t len = std::min<size_t>(end - p, field.size);
+        memcpy(column.bytes + offsets[row], p, len);
+        offsets[row + 1] = offsets[row] + len;
+    }
+    return true;
+
+    case DataType::MYSQL_DATE:
+        return FieldParser::parseDate(p, end, static_cast<MYSQL_TIME *>(column.data)[row]);
+
+    case DataType::MYSQL_DATETIME:
+        return FieldParser::parseDateTime(p, end, static_cast<MYSQL_TIME *>(column.data)[row]);
+    }
+
+    return false;
+}
+
+CSVParser::CSVParser(const CSVOptions &options, ChunkPool *pool)
+:   _options(options),
+    _pool(pool),
+    _maxRows(pool ? pool->rows() : CSV::rowsPerChunk(options))
+{
+    _structural.resize(SCAN_WINDOW);
+
+    for (size_t j = 0; j < options.fields.size(); ++j) {
+        if (options.fields[j].type == DataType::STRING) _stringColumns.push_back(j);
+    }
+}
+
+CSVParser::~CSVParser() {
+    if (_chunk == nullptr) return;
+
+    if (_pool) _pool->release(_chunk);
+    else delete _chunk;
+}
+
+void CSVParser::setInput(
+    const char *begin,
+    const char *end,
     const char *path,
-    const CSVOptions &options
+    size_t offset
 ) {
-    size_t rowSize = estimatedRowSize(options);
-    size_t maxRows = options.maxChunkSize / rowSize;
-    size_t numColumns = options.fields.size();
+    _begin = _pos = _scanned = begin;
+    _end = end;
+    _path = path;
+    _offset = offset;
+    _structuralPos = _structuralCount = 0;
+}
 
-    File f(path);
-    char *buffer = new char[f.info().length()];
-    auto sz = f.read(buffer, f.info().length());
+const char * CSVParser::_nextStructural() {
+    while (_structuralPos == _structuralCount) {
+        size_t len = std::min<size_t>(_end - _scanned, SCAN_WINDOW);
+        _scanBase = _scanned;
+        _structuralCount = CSVScanner::scan(
+            _scanned,
+            len,
+            _options.delimiter,
+            _structural.data()
+        );
+        _structuralPos = 0;
+        _scanned += len;
+    }
 
-    size_t i = 0;
-    std::vector<ColumnChunk> columns = allocateColumns(options, maxRows);
-    std::vector<ColumnarTableChunk *> chunks;
+    return _scanBase + _structural[_structuralPos++];
+}
+
+bool CSVParser::_stringsFit() const {
+    for (auto j : _stringColumns) {
+        const auto &c = _chunk->columns[j];
+        if (c.bytesCapacity - c.offsets()[_rows] < _options.fields[j].size) return false;
+    }
+    return true;
+}
+
+void CSVParser::_parseRow() {
+    size_t numColumns = _options.fields.size();
+
+    for (size_t j = 0; j < numColumns; ++j) {
+        const char *delim = _nextStructural();
+        if (*delim == '\n' && j != numColumns - 1) {
+            std::stringstream msg;
+            msg << _path << ": expected " << numColumns << " fields, found " << j + 1
+                << " at offset " << _offset + (_pos - _begin);
+            throw DynamicMessageError(msg.str().c_str());
+        }
+        bool eol = *delim == '\n';
+
+        // the last field of a CRLF line ends before the \r
+        const char *fieldEnd = delim;
+        if (eol && fieldEnd != _pos && fieldEnd[-1] == '\r') --fieldEnd;
+
+        if (! convertField(_pos, fieldEnd, _options.fields[j], _chunk->columns[j], _rows)) {
+            std::stringstream msg;
+            msg << _path << ": invalid " << typeName(_options.fields[j].type)
+                << " value '" << std::string(_pos, fieldEnd) << "' at offset "
+                << _offset + (_pos - _begin);
+            throw DynamicMessageError(msg.str().c_str());
+        }
+
+        _pos = delim + 1;
+
+        // ignore trailing delimiters and extra fields
+        while (j == numColumns - 1 && ! eol) {
+            delim = _nextStructural();
+            eol = *delim == '\n';
+            _pos = delim + 1;
+        }
+    }
+}
+
+ColumnarTableChunk * CSVParser::_finishChunk() {
+    for (auto &c : _chunk->columns) {
+        c.size = _rows;
+    }
+
+    auto chunk = _chunk;
+    _chunk = nullptr;
+    _rows = 0;
+    return chunk;
+}
+
+ColumnarTableChunk * CSVParser::parse() {
+    while (_pos != _end) {
+        if (_chunk == nullptr) {
+            _chunk = _pool ? _pool->acquire() : allocateChunk(_options, _maxRows);
+        }
+
+        if (! _stringsFit()) return _finishChunk();
+
+        try {
+            _parseRow();
+        }
+        catch (...) {
+            // drop the rest of the input, the row is overwritten by the next
+            _pos = _end;
+            throw;
+        }
+
+        if (++_rows == _maxRows) return _finishChunk();
+    }
 
-    char *delim, *p = buffer, *end = buffer + sz;
+    return nullptr;
+}
+
+ColumnarTableChunk * CSVParser::flush() {
+    if (_chunk == nullptr || _rows == 0) return nullptr;
+
+    return _finishChunk();
+}
+
+CSVReader::CSVReader(const char *path, const CSVOptions &options)
+:   CSVReader(path, options, { 0, CSV::split(path, 1, 1).front().end })
+{ }
 
-    if (options.header) {
-        while (p != end && *p != '\n') ++p;
-        if (p != end) ++p;
+CSVReader::CSVReader(
+    const char *path,
+    const CSVOptions &options,
+    const CSVRange &range,
+    ChunkPool *pool
+):  _path(path),
+    _options(options),
+    _parser(options, pool),
+    _header(options.header && range.begin == 0),
+    _skipPartialLine(range.begin != 0),
+    _offset(range.begin == 0 ? 0 : range.begin - 1),
+    _readOffset(_offset),
+    _rangeEnd(range.end),
+    _capacity(options.blockSize)
+{
+    _fd = open(path, O_RDONLY);
+    if (_fd < 0) {
+        throw DynamicMessageError(strerror(errno));
     }
 
-    while (p < end) {
-        if (i == maxRows) {
-            chunks.push_back(new ColumnarTableChunk(columns));
-            columns = allocateColumns(options, maxRows);
-            i = 0;
+    auto compression = CompressedInput::detect(path);
+    _mapped = options.mmap && compression == Compression::NONE;
+
+    if (compression != Compression::NONE) {
+        // a range of a compressed file starts at a zstd frame, and the byte
+        // before it is the last of the previous frame, which would have to
+        // be decompressed whole for it; the range is read as if both of its
+        // ends were a byte later instead, so it starts at its own frame and
+        // the line that holds its end byte is finished by the range before
+        if (range.begin != 0) _offset = _readOffset = range.begin;
+        if (_rangeEnd != SIZE_MAX) ++_rangeEnd;
+
+        try {
+            _input = std::make_unique<CompressedInput>(_fd, path, compression, _offset);
+        }
+        catch (...) {
+            close(_fd);
+            throw;
         }
+    }
 
-        for (size_t j = 0; j < numColumns; ++j) {
-            delim = p;
-            while (delim != end && *delim != options.delimiter && *delim != '\n') ++delim;
-            if (delim == end) {
-                throw RuntimeError("Error reading CSV file");
-            }
-            *delim = '\0';
-
-            switch (options.fields[j].type) {
-                case DataType::UINT8: {
-                    static_cast<uint8 *>(columns[j].data)[i] =
-                        StringConversions::str_to_unsigned_int<uint8>(p);
-                }
-                break;
-
-                case DataType::UINT16: {
-                    static_cast<uint16 *>(columns[j].data)[i] =
-                        StringConversions::str_to_unsigned_int<uint16>(p);
-                }
-                break;
-
-                case DataType::UINT32: {
-                    static_cast<uint32 *>(columns[j].data)[i] =
-                        StringConversions::str_to_unsigned_int<uint32>(p);
-                }
-                break;
-
-                case DataType::UINT64: {
-                    static_cast<uint64 *>(columns[j].data)[i] =
-                        StringConversions::str_to_unsigned_int<uint64>(p);
-                }
-                break;
-
-                case DataType::INT8: {
-                    static_cast<int8 *>(columns[j].data)[i] =
-                        StringConversions::str_to_int<int8>(p);
-                }
-                break;
-
-                case DataType::INT16: {
-                    static_cast<int16 *>(columns[j].data)[i] =
-                        StringConversions::str_to_int<int16>(p);
-                }
-                break;
-
-                case DataType::INT32: {
-                    static_cast<int32 *>(columns[j].data)[i] =
-                        StringConversions::str_to_int<int32>(p);
-                }
-                break;
-
-                case DataType::INT64: {
-                    static_cast<int64 *>(columns[j].data)[i] =
-                        StringConversions::str_to_int<int64>(p);
-                }
-                break;
-
-                case DataType::FLOAT32: {
-                    static_cast<float32 *>(columns[j].data)[i] =
-                        StringConversions::str_to_float<float32>(p);
-                }
-                break;
-
-                case DataType::FLOAT64: {
-                    static_cast<float64 *>(columns[j].data)[i] =
-                        StringConversions::str_to_float<float64>(p);
-                }
-                break;
-
-                case DataType::STRING: {
-                    strcpy(static_cast<char **>(columns[j].data)[i], p);
-                }
-                break;
-
-                case DataType::MYSQL_DATE: {
-                    auto dt = strtok(p, "-");
-                    static_cast<MYSQL_TIME *>(columns[j].data)[i].year =
-                        StringConversions::str_to_unsigned_int<unsigned int>(dt);
-
-                    dt = strtok(nullptr, "-");
-                    static_cast<MYSQL_TIME *>(columns[j].data)[i].month =
-                        StringConversions::str_to_unsigned_int<unsigned int>(dt);
-
-                    dt = strtok(nullptr, "-");
-                    static_cast<MYSQL_TIME *>(columns[j].data)[i].day =
-                        StringConversions::str_to_unsigned_int<unsigned int>(dt);
-                }
-                break;
-            }
+    if (! _mapped) {
+        // one spare byte to terminate a last line that lacks a newline
+        _buffer = (char *) malloc(_capacity + 1);
+    }
+    _data = _pos = _end = _lineEnd = _buffer;
+
+    if (range.begin >= range.end) _eof = true;
+}
+
+CSVReader::~CSVReader() {
+    if (_map != nullptr) munmap(_map, _mapLength);
+    close(_fd);
+    free(_buffer);
+}
 
-            p = delim + 1;
+void CSVReader::_read() {
+    // move the partial line left over from the previous block to the front
+    size_t carry = _end - _pos;
+    memmove(_buffer, _pos, carry);
+    _offset += _pos - _data;
+    _data = _pos = _buffer;
+    _end = _buffer + carry;
+    _lineEnd = _buffer;
+
+    while (_lineEnd == _buffer && ! _eof) {
+        if (_end == _buffer + _capacity) {
+            // a single line is longer than the buffer
+            _buffer = (char *) realloc(_buffer, 2 * _capacity + 1);
+            _data = _pos = _buffer;
+            _end = _buffer + _capacity;
+            _capacity *= 2;
         }
 
-        ++i;
+        char *end = _buffer + (_end - _data);
+        ssize_t n = _input
+            ? (ssize_t) _input->read(end, _buffer + _capacity - end)
+            : pread(_fd, end, _buffer + _capacity - end, _readOffset);
+        if (n < 0) {
+            throw DynamicMessageError(strerror(errno));
+        }
+        else if (n == 0) {
+            _eof = true;
+            if (end != _buffer && end[-1] != '\n') *end++ = '\n';
+        }
+        else {
+            end += n;
+            _readOffset += n;
+        }
+        _end = end;
+
+        auto nl = (const char *) memrchr(_buffer, '\n', _end - _buffer);
+        _lineEnd = nl ? nl + 1 : _buffer;
     }
+}
 
-    for (size_t j = 0; j < numColumns; ++j) {
-        columns[j].size = i;
+void CSVReader::_mapFile() {
+    if (_map == nullptr) {
+        struct stat st;
+        if (fstat(_fd, &st)) {
+            throw DynamicMessageError(strerror(errno));
+        }
+        size_t length = st.st_size;
+        size_t aligned = _offset & ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+
+        if (length <= _offset) {
+            _eof = true;
+            return;
+        }
+
+        // the whole range is mapped up front, the last line of the range may
+        // extend past its end so the mapping runs to the end of the file
+        bool wholeFile = _offset == 0 && _rangeEnd >= length;
+        _mapLength = length - aligned;
+        _map = mmap(
+            nullptr,
+            _mapLength,
+            PROT_READ,
+            MAP_PRIVATE | (_options.populate && wholeFile ? MAP_POPULATE : 0),
+            _fd,
+            aligned
+        );
+        if (_map == MAP_FAILED) {
+            _map = nullptr;
+            throw DynamicMessageError(strerror(errno));
+        }
+
+        madvise(_map, _mapLength, MADV_SEQUENTIAL);
+        if (_options.populate && ! wholeFile) {
+            madvise(_map, std::min(_mapLength, _rangeEnd - aligned), MADV_WILLNEED);
+        }
+
+        _data = _pos = static_cast<const char *>(_map) + (_offset - aligned);
+        _end = static_cast<const char *>(_map) + _mapLength;
+
+        auto nl = (const char *) memrchr(_data, '\n', _end - _data);
+        _lineEnd = nl ? nl + 1 : _data;
+        if (_lineEnd == _end) _eof = true;
+    }
+    else {
+        // the mapping cannot be written to, so a last line that lacks a
+        // newline is copied out and terminated
+        size_t len = _end - _lineEnd;
+        _offset += _lineEnd - _data;
+        _buffer = (char *) realloc(_buffer, len + 1);
+        memcpy(_buffer, _lineEnd, len);
+        _buffer[len] = '\n';
+
+        _data = _pos = _buffer;
+        _end = _lineEnd = _buffer + len + 1;
+        _eof = true;
+    }
+}
+
+bool CSVReader::_fill() {
+    if (_eof) return false;
+
+    if (_mapped) {
+        _mapFile();
+    }
+    else {
+        _read();
+    }
+
+    // stop after the line that contains the last byte of the range
+    if (_lineEnd != _pos && _offset + (_lineEnd - _data) >= _rangeEnd) {
+        const char *last = _data + (_rangeEnd - 1 - _offset);
+        _lineEnd = (const char *) memchr(last, '\n', _lineEnd - last) + 1;
+        _eof = true;
+    }
+
+    // a range that starts mid-line leaves that line to the previous range
+    if ((_header || _skipPartialLine) && _pos != _lineEnd) {
+        _pos = (const char *) memchr(_pos, '\n', _lineEnd - _pos) + 1;
+        _header = false;
+        _skipPartialLine = false;
+    }
+
+    return true;
+}
+
+bool CSVReader::nextBlock(const char *&begin, const char *&end, size_t &offset) {
+    while (_pos == _lineEnd) {
+        if (! _fill()) return false;
+    }
+
+    // cut at the last line that ends within one block, or after the first
+    // line if that alone is longer
+    const char *limit = std::min(_lineEnd, _pos + _options.blockSize);
+    auto nl = (const char *) memrchr(_pos, '\n', limit - _pos);
+    if (nl == nullptr) {
+        nl = (const char *) memchr(limit, '\n', _lineEnd - limit);
+    }
+
+    begin = _pos;
+    end = nl + 1;
+    offset = _offset + (_pos - _data);
+
+    _pos = end;
+    return true;
+}
+
+ColumnarTableChunk * CSVReader::nextChunk() {
+    const char *begin, *end;
+    size_t offset;
+
+    for (;;) {
+        auto chunk = _parser.parse();
+        if (chunk != nullptr) return chunk;
+
+        if (! nextBlock(begin, end, offset)) return _parser.flush();
+
+        _parser.setInput(begin, end, _path.c_str(), offset);
+    }
+}
+
+std::vector<ColumnarTableChunk *> CSV::read(
+    const char *path,
+    const CSVOptions &options
+) {
+    CSVReader reader(path, options);
+    std::vector<ColumnarTableChunk *> chunks;
+
+    for (auto chunk = reader.nextChunk(); chunk != nullptr; chunk = reader.nextChunk()) {
+        chunks.push_back(chunk);
     }
-    chunks.push_back(new ColumnarTableChunk(columns));
 
-    delete[] buffer;
     return chunks;
 }
+
+std::vector<CSVRange> CSV::split(
+    const char *path,
+    size_t n,
+    size_t minSize
+) {
+    if (minSize == 0) minSize = 1;
+    if (n == 0) n = 1;
+
+    if (CompressedInput::detect(path) != Compression::NONE) {
+        auto frames = CompressedInput::frames(path);
+        if (frames.empty()) return { { 0, SIZE_MAX } };
+
+        // ranges end at the first frame at or past an even share of the
+        // contents, so readers start decompressing at a frame
+        const auto &last = frames.back();
+        size_t length = last.contentOffset + last.contentSize;
+        if (length == 0) return { { 0, 0 } };
+
+        n = std::max<size_t>(1, std::min(n, length / minSize));
+
+        std::vector<CSVRange> ranges;
+        size_t begin = 0, f = 0;
+        for (size_t i = 1; i <= n; ++i) {
+            size_t target = length * i / n;
+            while (f < frames.size() && frames[f].contentOffset < target) ++f;
+
+            size_t end = f < frames.size() ? frames[f].contentOffset : length;
+            if (end > begin) ranges.push_back({ begin, end });
+            begin = end;
+        }
+
+        return ranges;
+    }
+
+    size_t length = PathInfo(path).length();
+    n = std::max<size_t>(1, std::min(n, length / minSize));
+
+    std::vector<CSVRange> ranges(n);
+    for (size_t i = 0; i < n; ++i) {
+        ranges[i] = {
+            length * i / n,
+            length * (i + 1) / n
+        };
+    }
+
+    return ranges;
+}
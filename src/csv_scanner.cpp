@@ -0,0 +1,85 @@
+#include <csv_scanner.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static inline size_t emitOffsets(
+    uint64_t mask,
+    uint32_t base,
+    uint32_t *offsets,
+    size_t n
+) {
+    while (mask != 0) {
+        offsets[n++] = base + __builtin_ctzll(mask);
+        mask &= mask - 1;
+    }
+    return n;
+}
+
+size_t CSVScanner::scan(
+    const char *p,
+    size_t len,
+    char delimiter,
+    uint32_t *offsets
+) {
+    size_t i = 0, n = 0;
+
+#if defined(__AVX2__)
+    const __m256i d = _mm256_set1_epi8(delimiter);
+    const __m256i nl = _mm256_set1_epi8('\n');
+
+    for (; i + 64 <= len; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *) (p + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i *) (p + i + 32));
+
+        uint32_t mlo = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(lo, d),
+            _mm256_cmpeq_epi8(lo, nl)
+        ));
+        uint32_t mhi = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(hi, d),
+            _mm256_cmpeq_epi8(hi, nl)
+        ));
+
+        n = emitOffsets(((uint64_t) mhi << 32) | mlo, i, offsets, n);
+    }
+#elif defined(__SSE2__)
+    const __m128i d = _mm_set1_epi8(delimiter);
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for (; i + 64 <= len; i += 64) {
+        uint64_t mask = 0;
+        for (size_t k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (p + i + 16 * k));
+            uint64_t m = (uint32_t) _mm_movemask_epi8(_mm_or_si128(
+                _mm_cmpeq_epi8(v, d),
+                _mm_cmpeq_epi8(v, nl)
+            ));
+            mask |= m << (16 * k);
+        }
+
+        n = emitOffsets(mask, i, offsets, n);
+    }
+#endif
+
+    // scalar tail shorter than one block
+    for (; i < len; ++i) {
+        if (p[i] == delimiter || p[i] == '\n') offsets[n++] = i;
+    }
+
+    return n;
+}
+
+size_t CSVScanner::scanScalar(
+    const char *p,
+    size_t len,
+    char delimiter,
+    uint32_t *offsets
+) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (p[i] == delimiter || p[i] == '\n') offsets[n++] = i;
+    }
+    return n;
+}
@@ -0,0 +1,317 @@
+#include <data_generator.h>
+#include <calendar.h>
+#include <spec_parser.h>
+#include <mysql.h>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace spl;
+
+// 64 characters, so that one random byte picks one without bias
+static const char ALPHABET[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+
+static void fail(const char *spec, const char *reason) {
+    SpecParser::fail("column distribution", spec, reason);
+}
+
+static bool isReal(DataType type) {
+    return type == DataType::FLOAT32 || type == DataType::FLOAT64;
+}
+
+static bool isDate(DataType type) {
+    return type == DataType::MYSQL_DATE || type == DataType::MYSQL_DATETIME;
+}
+
+/**
+ * Whether value fits in an integer column of the given type.
+ */
+static bool fits(DataType type, int64_t value) {
+    switch (type) {
+    case DataType::UINT8: return value >= 0 && value <= UINT8_MAX;
+    case DataType::UINT16: return value >= 0 && value <= UINT16_MAX;
+    case DataType::UINT32: return value >= 0 && value <= UINT32_MAX;
+    case DataType::UINT64: return value >= 0;
+    case DataType::INT8: return value >= INT8_MIN && value <= INT8_MAX;
+    case DataType::INT16: return value >= INT16_MIN && value <= INT16_MAX;
+    case DataType::INT32: return value >= INT32_MIN && value <= INT32_MAX;
+    default: return true;
+    }
+}
+
+ColumnDistribution ColumnDistribution::parse(const char *spec, const CSVField &field) {
+    auto parts = SpecParser::split(spec);
+    const auto &name = parts[0];
+    bool number = field.type != DataType::STRING && ! isDate(field.type);
+
+    ColumnDistribution d;
+
+    if (name == "sequence") {
+        if (! number) fail(spec, "sequences are only generated for numbers");
+
+        d.kind = Kind::SEQUENCE;
+        d.low = 1;
+        if (parts.size() > 2 || (parts.size() == 2 && ! SpecParser::parseInteger(parts[1], d.low))) {
+            fail(spec, "expected sequence[:START]");
+        }
+    }
+    else if (name == "uniform") {
+        if (! number) fail(spec, "uniform values are only generated for numbers");
+        if (parts.size() != 3) fail(spec, "expected uniform:A:B");
+
+        d.kind = Kind::UNIFORM;
+        if (isReal(field.type)) {
+            if (! SpecParser::parseReal(parts[1], d.realLow) || ! SpecParser::parseReal(parts[2], d.realHigh)) {
+                fail(spec, "the bounds are not numbers");
+            }
+            if (d.realLow > d.realHigh) fail(spec, "the bounds are reversed");
+        }
+        else {
+            if (! SpecParser::parseInteger(parts[1], d.low) || ! SpecParser::parseInteger(parts[2], d.high)) {
+                fail(spec, "the bounds are not integers");
+            }
+            if (d.low > d.high) fail(spec, "the bounds are reversed");
+            if (! fits(field.type, d.low) || ! fits(field.type, d.high)) {
+                fail(spec, "the bounds do not fit the column type");
+            }
+        }
+    }
+    else if (name == "zipf") {
+        if (! number) fail(spec, "Zipf values are only generated for numbers");
+
+        double s;
+        int64_t n;
+        if (parts.size() != 3 || ! SpecParser::parseReal(parts[1], s) || ! SpecParser::parseInteger(parts[2], n)) {
+            fail(spec, "expected zipf:S:N");
+        }
+        if (s <= 0 || n < 1) fail(spec, "S and N must be positive");
+        if (! fits(field.type, n)) fail(spec, "N does not fit the column type");
+
+        d.kind = Kind::ZIPF;
+        d.zipf = std::make_shared<ZipfDistribution>(s, n);
+    }
+    else if (name == "random") {
+        if (field.type != DataType::STRING) fail(spec, "random strings are only generated for strings");
+
+        if (parts.size() != 3 || ! SpecParser::parseInteger(parts[1], d.low) || ! SpecParser::parseInteger(parts[2], d.high)) {
+            fail(spec, "expected random:MIN:MAX");
+        }
+        if (d.low < 0 || d.low > d.high) fail(spec, "the lengths are reversed or negative");
+        if ((size_t) d.high > field.size) fail(spec, "MAX is longer than the declared size");
+
+        d.kind = Kind::RANDOM;
+    }
+    else if (name == "date_range") {
+        if (! isDate(field.type)) fail(spec, "date ranges are only generated for dates");
+
+        if (parts.size() != 3 || ! SpecParser::parseDay(parts[1], d.low) || ! SpecParser::parseDay(parts[2], d.high)) {
+            fail(spec, "expected date_range:YYYY-MM-DD:YYYY-MM-DD");
+        }
+        if (d.low > d.high) fail(spec, "the bounds are reversed");
+
+        d.kind = Kind::DATE_RANGE;
+    }
+    else {
+        fail(spec, "unknown distribution");
+    }
+
+    return d;
+}
+
+ColumnDistribution ColumnDistribution::defaultFor(const CSVField &field) {
+    ColumnDistribution d;
+
+    if (field.type == DataType::STRING) {
+        d.kind = Kind::RANDOM;
+        d.low = 0;
+        d.high = field.size;
+    }
+    else if (isDate(field.type)) {
+        d.kind = Kind::DATE_RANGE;
+        d.low = 0;
+        d.high = Calendar::daysFromCivil(2037, 12, 31);
+    }
+    else {
+        d.kind = Kind::SEQUENCE;
+        d.low = 1;
+    }
+
+    return d;
+}
+
+DataGenerator::DataGenerator(const std::vector<ColumnDistribution> &columns, uint64_t seed)
+:   _columns(columns),
+    _seed(seed)
+{ }
+
+double DataGenerator::stringFill(
+    const CSVOptions &options,
+    const std::vector<ColumnDistribution> &columns
+) {
+    double fill = 0;
+
+    for (size_t j = 0; j < options.fields.size(); ++j) {
+        const auto &f = options.fields[j];
+        if (f.type != DataType::STRING || f.size == 0) continue;
+
+        fill = std::max(fill, (double) columns[j].high / f.size);
+    }
+
+    // rounded up, so that capacity never falls a byte short
+    return fill == 0 ? 1 : std::min(1.0, fill + 1e-9);
+}
+
+template <typename T>
+static void fillNumbers(
+    T *data,
+    const ColumnDistribution &d,
+    Random &random,
+    uint64_t firstRow,
+    size_t rows
+) {
+    switch (d.kind) {
+    case ColumnDistribution::Kind::SEQUENCE:
+        for (size_t i = 0; i < rows; ++i) data[i] = (T) (d.low + (int64_t) (firstRow + i));
+        break;
+
+    case ColumnDistribution::Kind::UNIFORM:
+        if constexpr (std::is_floating_point_v<T>) {
+            double span = d.realHigh - d.realLow;
+            for (size_t i = 0; i < rows; ++i) data[i] = (T) (d.realLow + random.uniform() * span);
+        }
+        else {
+            uint64_t span = (uint64_t) d.high - (uint64_t) d.low + 1;
+            for (size_t i = 0; i < rows; ++i) data[i] = (T) (d.low + (int64_t) random.below(span));
+        }
+        break;
+
+    case ColumnDistribution::Kind::ZIPF:
+        for (size_t i = 0; i < rows; ++i) data[i] = (T) (*d.zipf)(random);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void fillStrings(ColumnChunk &column, const ColumnDistribution &d, Random &random, size_t rows) {
+    auto offsets = static_cast<uint32_t *>(column.data);
+    uint64_t span = d.high - d.low + 1;
+
+    offsets[0] = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        size_t len = d.low + random.below(span);
+        char *p = column.bytes + offsets[i];
+
+        // eight characters out of every random number
+        for (size_t k = 0; k < len; k += 8) {
+            uint64_t bits = random.next();
+            size_t n = std::min<size_t>(8, len - k);
+            for (size_t b = 0; b < n; ++b, bits >>= 8) p[k + b] = ALPHABET[bits & 63];
+        }
+
+        offsets[i + 1] = offsets[i] + len;
+    }
+}
+
+static void fillDates(ColumnChunk &column, const ColumnDistribution &d, Random &random, size_t rows) {
+    auto data = static_cast<MYSQL_TIME *>(column.data);
+    uint64_t span = d.high - d.low + 1;
+    bool datetime = column.type == DataType::MYSQL_DATETIME;
+
+    for (size_t i = 0; i < rows; ++i) {
+        auto &t = data[i];
+        t = MYSQL_TIME();
+
+        int y;
+        Calendar::civilFromDays(d.low + (int64_t) random.below(span), y, t.month, t.day);
+        t.year = y;
+
+        if (datetime) {
+            unsigned s = random.below(24 * 60 * 60);
+            t.hour = s / 3600;
+            t.minute = s / 60 % 60;
+            t.second = s % 60;
+            t.time_type = MYSQL_TIMESTAMP_DATETIME;
+        }
+        else {
+            t.time_type = MYSQL_TIMESTAMP_DATE;
+        }
+    }
+}
+
+void DataGenerator::_fillColumn(
+    ColumnChunk &column,
+    size_t index,
+    uint64_t firstRow,
+    size_t rows
+) const {
+    const auto &d = _columns[index];
+
+    // one stream per column and row range, so ranges do not depend on each
+    // other
+    Random random(_seed + firstRow * _columns.size() + index);
+
+    switch (column.type) {
+    case DataType::UINT8:
+        fillNumbers(static_cast<uint8_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::UINT16:
+        fillNumbers(static_cast<uint16_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::UINT32:
+        fillNumbers(static_cast<uint32_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::UINT64:
+        fillNumbers(static_cast<uint64_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::INT8:
+        fillNumbers(static_cast<int8_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::INT16:
+        fillNumbers(static_cast<int16_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::INT32:
+        fillNumbers(static_cast<int32_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::INT64:
+        fillNumbers(static_cast<int64_t *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::FLOAT32:
+        fillNumbers(static_cast<float *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::FLOAT64:
+        fillNumbers(static_cast<double *>(column.data), d, random, firstRow, rows);
+        break;
+
+    case DataType::STRING:
+        fillStrings(column, d, random, rows);
+        break;
+
+    case DataType::MYSQL_DATE:
+    case DataType::MYSQL_DATETIME:
+        fillDates(column, d, random, rows);
+        break;
+    }
+
+    column.size = rows;
+}
+
+void DataGenerator::fill(ColumnarTableChunk *chunk, uint64_t firstRow, size_t rows) const {
+    for (size_t j = 0; j < chunk->columns.size(); ++j) {
+        _fillColumn(chunk->columns[j], j, firstRow, rows);
+    }
+}
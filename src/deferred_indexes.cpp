@@ -0,0 +1,132 @@
+#include <deferred_indexes.h>
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+
+// reads the `quoted` identifier at s[pos], in which `` stands for a
+// backtick, leaving pos after it; returns false if there is none
+static bool readIdentifier(const std::string &s, size_t &pos, std::string &name) {
+    if (pos >= s.size() || s[pos] != '`') return false;
+
+    name.clear();
+    for (size_t i = pos + 1; i < s.size(); ++i) {
+        if (s[i] != '`') {
+            name += s[i];
+        }
+        else if (i + 1 < s.size() && s[i + 1] == '`') {
+            name += '`';
+            ++i;
+        }
+        else {
+            pos = i + 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static std::string quote(const std::string &name) {
+    std::string quoted = "`";
+    for (char c : name) {
+        quoted += c;
+        if (c == '`') quoted += '`';
+    }
+    return quoted + "`";
+}
+
+// reads the columns of the parenthesized key part list that starts at or
+// after pos; an expression, which only functional indexes have, reads as an
+// empty name
+static std::vector<std::string> readColumns(const std::string &s, size_t pos) {
+    std::vector<std::string> columns;
+
+    pos = s.find('(', pos);
+    if (pos == std::string::npos) return columns;
+    ++pos;
+
+    while (pos < s.size()) {
+        std::string name;
+        if (! readIdentifier(s, pos, name)) name.clear();
+        columns.push_back(name);
+
+        // skip a prefix length, ASC or DESC, or the expression, up to the
+        // comma or parenthesis that ends the part
+        int depth = 0;
+        while (pos < s.size() && (depth > 0 || (s[pos] != ',' && s[pos] != ')'))) {
+            if (s[pos] == '(') ++depth;
+            else if (s[pos] == ')') --depth;
+            ++pos;
+        }
+
+        if (pos >= s.size() || s[pos] == ')') break;
+        ++pos;
+    }
+
+    return columns;
+}
+
+static bool startsWith(const std::string &s, const char *prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+DeferredIndexes::DeferredIndexes(const std::string &table, const std::string &createTable)
+:   _table(table)
+{
+    std::vector<std::vector<std::string>> foreignKeys;
+    std::vector<std::pair<DeferredIndex, std::vector<std::string>>> keys;
+
+    // SHOW CREATE TABLE puts every column, index and constraint on a line
+    // of its own
+    std::istringstream lines(createTable);
+    std::string line;
+    while (std::getline(lines, line)) {
+        auto begin = line.find_first_not_of(" \t");
+        if (begin == std::string::npos) continue;
+        line.erase(0, begin);
+        if (! line.empty() && line.back() == ',') line.pop_back();
+
+        if (startsWith(line, "CONSTRAINT ")) {
+            auto fk = line.find(" FOREIGN KEY ");
+            if (fk != std::string::npos) foreignKeys.push_back(readColumns(line, fk));
+        }
+        else if (startsWith(line, "KEY `")) {
+            size_t pos = 4;
+            DeferredIndex index;
+            if (! readIdentifier(line, pos, index.name)) continue;
+
+            index.definition = line;
+            keys.push_back({ index, readColumns(line, pos) });
+        }
+    }
+
+    // a foreign key needs an index that starts with its columns
+    for (const auto &[index, columns] : keys) {
+        bool needed = false;
+        for (const auto &fk : foreignKeys) {
+            if (fk.size() <= columns.size() && std::equal(fk.begin(), fk.end(), columns.begin())) {
+                needed = true;
+            }
+        }
+
+        if (! needed) _indexes.push_back(index);
+    }
+}
+
+std::string DeferredIndexes::dropStatement() const {
+    std::stringstream sql;
+    sql << "ALTER TABLE " << _table;
+    for (size_t i = 0; i < _indexes.size(); ++i) {
+        sql << (i == 0 ? " " : ", ") << "DROP INDEX " << quote(_indexes[i].name);
+    }
+    return sql.str();
+}
+
+std::string DeferredIndexes::addStatement() const {
+    std::stringstream sql;
+    sql << "ALTER TABLE " << _table;
+    for (size_t i = 0; i < _indexes.size(); ++i) {
+        sql << (i == 0 ? " " : ", ") << "ADD " << _indexes[i].definition;
+    }
+    return sql.str();
+}
@@ -0,0 +1,133 @@
+#include <ingest_scheduler.h>
+#include <file.h>
+#include <algorithm>
+
+using namespace spl;
+
+// slices planned for every worker when the largest file is big enough, so
+// that the work left at the end of a load is small enough to share out
+#define SLICES_PER_WORKER 4
+
+IngestScheduler::IngestScheduler(
+    const std::vector<std::string> &paths,
+    size_t workers,
+    size_t minSize
+):  _steals(0)
+{
+    workers = std::max<size_t>(workers, 1);
+    minSize = std::max<size_t>(minSize, 1);
+
+    struct Input {
+        const std::string *path;
+        uint64_t bytes;
+        bool splittable;
+    };
+
+    std::vector<Input> inputs;
+    for (const auto &path : paths) {
+        auto whole = CSV::split(path.c_str(), 1, 1).front();
+        if (whole.end == SIZE_MAX) {
+            inputs.push_back({ &path, PathInfo(path.c_str()).length(), false });
+        }
+        else {
+            inputs.push_back({ &path, whole.end, true });
+        }
+        _bytes += inputs.back().bytes;
+    }
+    _files = inputs.size();
+
+    uint64_t sliceSize = std::max<uint64_t>(minSize, _bytes / (workers * SLICES_PER_WORKER));
+
+    std::vector<Slice> slices;
+    std::vector<bool> whole;
+    for (const auto &input : inputs) {
+        // an empty file has no slice to read
+        if (input.splittable && input.bytes == 0) continue;
+
+        if (! input.splittable) {
+            slices.push_back({ { *input.path, { 0, SIZE_MAX } }, input.bytes });
+            whole.push_back(true);
+            continue;
+        }
+
+        size_t n = (input.bytes + sliceSize - 1) / sliceSize;
+        for (const auto &range : CSV::split(input.path->c_str(), n, minSize)) {
+            slices.push_back({ { *input.path, range }, range.end - range.begin });
+            whole.push_back(false);
+        }
+    }
+
+    // indivisible files first, then largest first; slices of one file keep
+    // their order, so readers move through it front to back together
+    std::vector<size_t> order(slices.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (whole[a] != whole[b]) return (bool) whole[a];
+        return slices[a].bytes > slices[b].bytes;
+    });
+
+    for (size_t i = 0; i < workers; ++i) _queues.emplace_back(new Queue());
+
+    // each slice goes to the worker with the least work so far
+    for (size_t i : order) {
+        auto least = std::min_element(_queues.begin(), _queues.end(), [](const auto &a, const auto &b) {
+            return a->bytes < b->bytes;
+        });
+
+        (*least)->bytes += slices[i].bytes;
+        (*least)->slices.push_back(std::move(slices[i]));
+    }
+    _slices = slices.size();
+}
+
+bool IngestScheduler::next(size_t worker, CSVWork &work) {
+    auto &queue = *_queues[worker % _queues.size()];
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        if (! queue.slices.empty()) {
+            auto &slice = queue.slices.front();
+            work = std::move(slice.work);
+            queue.bytes -= slice.bytes;
+            queue.slices.pop_front();
+            return true;
+        }
+    }
+
+    return _steal(worker, work);
+}
+
+bool IngestScheduler::_steal(size_t worker, CSVWork &work) {
+    // no slices are added once planned, so once every queue is found empty
+    // there is nothing left to take
+    while (true) {
+        Queue *victim = nullptr;
+        uint64_t most = 0;
+
+        for (size_t i = 0; i < _queues.size(); ++i) {
+            if (i == worker % _queues.size()) continue;
+
+            auto &queue = *_queues[i];
+            std::lock_guard<std::mutex> lock(queue.mtx);
+            if (! queue.slices.empty() && (victim == nullptr || queue.bytes > most)) {
+                victim = &queue;
+                most = queue.bytes;
+            }
+        }
+
+        if (victim == nullptr) return false;
+
+        // the owner works from the front, so the back is the work it would
+        // get to last
+        std::lock_guard<std::mutex> lock(victim->mtx);
+        if (victim->slices.empty()) continue;
+
+        auto &slice = victim->slices.back();
+        work = std::move(slice.work);
+        victim->bytes -= slice.bytes;
+        victim->slices.pop_back();
+
+        ++_steals;
+        return true;
+    }
+}
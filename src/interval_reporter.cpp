@@ -0,0 +1,137 @@
+#include <interval_reporter.h>
+#include <exception.h>
+#include <iostream>
+#include <sstream>
+
+using namespace spl;
+
+IntervalReporter::IntervalReporter(double interval, const char *path, Format format)
+:   _interval(interval),
+    _format(format)
+{
+    if (path != nullptr) {
+        _file.open(path, std::ios::out | std::ios::trunc);
+        if (! _file) {
+            std::stringstream msg;
+            msg << "Cannot open report file '" << path << "'";
+            throw DynamicMessageError(msg.str().c_str());
+        }
+    }
+}
+
+IntervalReporter::~IntervalReporter() {
+    stop();
+}
+
+IntervalReporter::Counters * IntervalReporter::counters() {
+    std::unique_lock lk(_mtx);
+
+    auto &c = _counters.emplace_back();
+    _sources.push_back({ &c });
+    return &c;
+}
+
+void IntervalReporter::start() {
+    _start = _last = std::chrono::steady_clock::now();
+
+    if (_file.is_open() && _format == Format::CSV) {
+        _file << "time,interval,queries,qps,rows,rows_per_second,errors,"
+            "p50,p90,p99,p99.9,max\n";
+    }
+
+    _thread = std::thread([this] { _run(); });
+}
+
+void IntervalReporter::stop() {
+    if (! _thread.joinable()) return;
+
+    {
+        std::unique_lock lk(_mtx);
+        _stop = true;
+    }
+    _wakeup.notify_all();
+    _thread.join();
+
+    std::unique_lock lk(_mtx);
+    _report(std::chrono::steady_clock::now());
+}
+
+void IntervalReporter::_run() {
+    std::unique_lock lk(_mtx);
+
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(_interval);
+
+    while (! _wakeup.wait_until(lk, _last + interval, [this] { return _stop; })) {
+        _report(std::chrono::steady_clock::now());
+    }
+}
+
+void IntervalReporter::_report(std::chrono::steady_clock::time_point now) {
+    double elapsed = std::chrono::duration<double>(now - _last).count();
+    double time = std::chrono::duration<double>(now - _start).count();
+    if (elapsed <= 0) return;
+
+    uint64_t queries = 0, rows = 0, errors = 0;
+    LatencyHistogram latency;
+
+    for (auto &s : _sources) {
+        // copied first, so nothing recorded while this runs is lost
+        LatencyHistogram current(s.counters->_latency);
+        latency.mergeDifference(current, s.latency);
+        s.latency = current;
+
+        uint64_t n = s.counters->_queries.load(std::memory_order_relaxed);
+        queries += n - s.queries;
+        s.queries = n;
+
+        n = s.counters->_rows.load(std::memory_order_relaxed);
+        rows += n - s.rows;
+        s.rows = n;
+
+        n = s.counters->_errors.load(std::memory_order_relaxed);
+        errors += n - s.errors;
+        s.errors = n;
+    }
+
+    _last = now;
+
+    std::cout << "[" << time << "s] " << queries / elapsed << " queries/s, "
+        << rows / elapsed << " rows/s, " << errors << " errors, latency ";
+    latency.print(std::cout);
+    std::cout << std::endl;
+
+    if (! _file.is_open()) return;
+
+    switch (_format) {
+    case Format::CSV:
+        _file << time << ',' << elapsed
+            << ',' << queries << ',' << queries / elapsed
+            << ',' << rows << ',' << rows / elapsed
+            << ',' << errors
+            << ',' << latency.percentile(50) / 1e9
+            << ',' << latency.percentile(90) / 1e9
+            << ',' << latency.percentile(99) / 1e9
+            << ',' << latency.percentile(99.9) / 1e9
+            << ',' << latency.max() / 1e9
+            << '\n';
+        break;
+
+    case Format::JSON:
+        _file << "{\"time\":" << time
+            << ",\"interval\":" << elapsed
+            << ",\"queries\":" << queries
+            << ",\"qps\":" << queries / elapsed
+            << ",\"rows\":" << rows
+            << ",\"rows_per_second\":" << rows / elapsed
+            << ",\"errors\":" << errors
+            << ",\"p50\":" << latency.percentile(50) / 1e9
+            << ",\"p90\":" << latency.percentile(90) / 1e9
+            << ",\"p99\":" << latency.percentile(99) / 1e9
+            << ",\"p99.9\":" << latency.percentile(99.9) / 1e9
+            << ",\"max\":" << latency.max() / 1e9
+            << "}\n";
+        break;
+    }
+
+    _file.flush();
+}
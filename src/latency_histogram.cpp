@@ -0,0 +1,145 @@
+#include <latency_histogram.h>
+#include <algorithm>
+#include <string>
+
+LatencyHistogram::LatencyHistogram()
+:   _counts(new Counter[_numBuckets()])
+{
+    reset();
+}
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram &other)
+:   LatencyHistogram()
+{
+    *this = other;
+}
+
+LatencyHistogram & LatencyHistogram::operator=(const LatencyHistogram &other) {
+    for (size_t i = 0; i < _numBuckets(); ++i) {
+        _set(_counts[i], _get(other._counts[i]));
+    }
+
+    _set(_count, _get(other._count));
+    _set(_sum, _get(other._sum));
+    _set(_min, _get(other._min));
+    _set(_max, _get(other._max));
+
+    return *this;
+}
+
+uint64_t LatencyHistogram::_lowestEquivalent(size_t index) {
+    if (index < SUB_BUCKETS) return index;
+
+    uint64_t shift = index / HALF_SUB_BUCKETS - 1;
+    uint64_t sub = index - shift * HALF_SUB_BUCKETS;
+    return sub << shift;
+}
+
+uint64_t LatencyHistogram::_highestEquivalent(size_t index) {
+    if (index < SUB_BUCKETS) return index;
+
+    uint64_t shift = index / HALF_SUB_BUCKETS - 1;
+    uint64_t sub = index - shift * HALF_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < _numBuckets(); ++i) {
+        _add(_counts[i], _get(other._counts[i]));
+    }
+
+    _add(_count, _get(other._count));
+    _add(_sum, _get(other._sum));
+    _set(_min, std::min(_get(_min), _get(other._min)));
+    _set(_max, std::max(_get(_max), _get(other._max)));
+}
+
+void LatencyHistogram::mergeDifference(
+    const LatencyHistogram &current,
+    const LatencyHistogram &previous
+) {
+    for (size_t i = 0; i < _numBuckets(); ++i) {
+        uint64_t n = _get(current._counts[i]) - _get(previous._counts[i]);
+        if (n == 0) continue;
+
+        _add(_counts[i], n);
+        _set(_min, std::min(_get(_min), _lowestEquivalent(i)));
+        _set(_max, std::max(_get(_max), _highestEquivalent(i)));
+    }
+
+    _add(_count, _get(current._count) - _get(previous._count));
+    _add(_sum, _get(current._sum) - _get(previous._sum));
+}
+
+void LatencyHistogram::reset() {
+    for (size_t i = 0; i < _numBuckets(); ++i) {
+        _set(_counts[i], 0);
+    }
+
+    _set(_count, 0);
+    _set(_sum, 0);
+    _set(_min, UINT64_MAX);
+    _set(_max, 0);
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    uint64_t count = this->count();
+    if (count == 0) return 0;
+
+    // rank of the value sought, counting from 1
+    uint64_t rank = (uint64_t) (percent / 100 * count + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, count);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < _numBuckets(); ++i) {
+        seen += _get(_counts[i]);
+        if (seen >= rank) return std::min(_highestEquivalent(i), max());
+    }
+
+    return max();
+}
+
+void LatencyHistogram::writeCSVHeader(std::ostream &out) {
+    out << "scope,name,count,mean,min,p50,p90,p99,p99.9,max\n";
+}
+
+void LatencyHistogram::writeCSV(
+    std::ostream &out,
+    const char *scope,
+    const std::string &name
+) const {
+    out << scope << ",\"";
+
+    // one line per entry, so query texts are folded onto one line
+    bool space = false, first = true;
+    for (auto c : name) {
+        if (c == '\n' || c == '\r' || c == '\t' || c == ' ') {
+            space = true;
+            continue;
+        }
+        if (space && ! first) out << ' ';
+        space = first = false;
+
+        if (c == '"') out << '"';
+        out << c;
+    }
+
+    out << "\"," << count()
+        << ',' << mean() / 1e9
+        << ',' << min() / 1e9
+        << ',' << percentile(50) / 1e9
+        << ',' << percentile(90) / 1e9
+        << ',' << percentile(99) / 1e9
+        << ',' << percentile(99.9) / 1e9
+        << ',' << max() / 1e9
+        << '\n';
+}
+
+void LatencyHistogram::print(std::ostream &out) const {
+    out << "p50 " << percentile(50) / 1e6
+        << " ms, p90 " << percentile(90) / 1e6
+        << " ms, p99 " << percentile(99) / 1e6
+        << " ms, p99.9 " << percentile(99.9) / 1e6
+        << " ms, max " << max() / 1e6
+        << " ms";
+}
@@ -1,5 +1,21 @@
 #include <mysql_database.h>
+#include <async_mysql_database.h>
 #include <csv.h>
+#include <chunk_pool.h>
+#include <bounded_queue.h>
+#include <latency_histogram.h>
+#include <rate_schedule.h>
+#include <interval_reporter.h>
+#include <query_template.h>
+#include <data_generator.h>
+#include <columnar_file.h>
+#include <compressed_input.h>
+#include <ingest_scheduler.h>
+#include <run_phases.h>
+#include <workload.h>
+#include <shard_router.h>
+#include <chunk_sorter.h>
+#include <deferred_indexes.h>
 #include <string.h>
 #include <iostream>
 #include <file.h>
@@ -7,6 +23,13 @@
 #include <mutex>
 #include <sync_condition.h>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <random>
 
 #define MB ((size_t) (1024 * 1024))
 
@@ -28,26 +51,167 @@ static struct {
     const char *table = nullptr;
 
     size_t threads = 1;
+    size_t connectionsPerThread = 1;
+    size_t readers = 1;
+    size_t parsers = 0;
+    size_t blockQueueDepth = 4;
+    size_t chunkQueueDepth = 4;
 
     size_t maxMemory = 128 * MB;
+    bool hugePages = false;
 
-    size_t duration = 1;
+    // seconds a --test-query-limit run lasts, 1 if not given, and seconds
+    // the measured phase of a --run lasts, which otherwise ends when its
+    // iterations are done
+    size_t duration = 0;
 
     bool loadCsv = false;
     const char *csvPath = nullptr;
     CSVOptions *csvOptions = nullptr;
+    LoadOptions loadOptions;
+
+    // rows made up by DataGenerator instead of read from CSV files, with the
+    // column types in csvOptions
+    bool generate = false;
+    uint64_t generateRows = 0;
+    std::vector<ColumnDistribution> distributions;
+
+    // write the parsed or generated chunks to a columnar snapshot instead of
+    // loading them
+    const char *convertPath = nullptr;
+
+    bool loadBin = false;
+    const char *binPath = nullptr;
+
+    // tables the loaded rows are spread over by the key column, in place of
+    // --table
+    std::vector<ShardTarget> shards;
+    const char *shardKey = nullptr;
+
+    // key columns the rows of each chunk are sorted by before loading
+    const char *sortBy = nullptr;
+
+    // drop the secondary indexes of the loaded tables before loading and
+    // build them again afterwards
+    bool deferIndexes = false;
 
     bool runQueries = false;
     const char *queryPath = nullptr;
     const char *queryStatPath = "result";
 
+    // passes each stream of a --run makes over its query file, or
+    // transactions each connection of a --workload runs, or 0 to loop until
+    // the duration is up
+    size_t iterations = 0;
+
+    // seconds over which a --run or --workload brings up its connections,
+    // and seconds it runs after that before it starts measuring
+    double rampUp = 0;
+    double warmUp = 0;
+
+    // a mix of transactions run by every connection, see Workload
+    const char *workloadPath = nullptr;
+
+    // times a transaction that hit a deadlock or lock wait timeout is run
+    // again before it counts as failed
+    size_t maxRetries = 10;
+
     bool testQueryLimit = false;
+
+    // queries per second of an open-loop run, or 0 for a closed loop
+    double rate = 0;
+
+    // send queries through cached server-side prepared statements
+    bool prepared = false;
+
+    // seed of the values generated for query templates
+    uint64_t seed = std::random_device()();
+
+    // seconds between progress reports, or 0 for none
+    double reportInterval = 0;
+    const char *reportPath = nullptr;
+    IntervalReporter::Format reportFormat = IntervalReporter::Format::CSV;
 } args;
 
 static std::mutex _connectionsMtx;
 static std::vector<Database *> connections;
 static thread_local Database *db;
 
+static IntervalReporter *reporter = nullptr;
+static thread_local IntervalReporter::Counters *counters = nullptr;
+
+// puts chunks in key order before they are loaded, with --sort-by
+static std::unique_ptr<ChunkSorter> sorter;
+static thread_local ChunkSorter::Buffer sortBuffer;
+static std::atomic<size_t> sortedChunks(0);
+static std::atomic<size_t> reorderedChunks(0);
+static std::atomic<uint64_t> sortTime(0);
+
+/**
+ * Parses a column type such as uint32 or string(32) at p, which is modified,
+ * and appends it to fields.
+ */
+static bool parseField(char *p, std::vector<CSVField> &fields, const char *option) {
+    if (strncmp(p, "uint8", 5) == 0) {
+        fields.push_back(CSVField(DataType::UINT8));
+    }
+    else if (strncmp(p, "uint16", 6) == 0) {
+        fields.push_back(CSVField(DataType::UINT16));
+    }
+    else if (strncmp(p, "uint32", 6) == 0) {
+        fields.push_back(CSVField(DataType::UINT32));
+    }
+    else if (strncmp(p, "uint64", 6) == 0) {
+        fields.push_back(CSVField(DataType::UINT64));
+    }
+    else if (strncmp(p, "int8", 4) == 0) {
+        fields.push_back(CSVField(DataType::INT8));
+    }
+    else if (strncmp(p, "int16", 5) == 0) {
+        fields.push_back(CSVField(DataType::INT16));
+    }
+    else if (strncmp(p, "int32", 5) == 0) {
+        fields.push_back(CSVField(DataType::INT32));
+    }
+    else if (strncmp(p, "int64", 5) == 0) {
+        fields.push_back(CSVField(DataType::INT64));
+    }
+    else if (strncmp(p, "float32", 7) == 0) {
+        fields.push_back(CSVField(DataType::FLOAT32));
+    }
+    else if (strncmp(p, "float64", 7) == 0) {
+        fields.push_back(CSVField(DataType::FLOAT64));
+    }
+    else if (strncmp(p, "string", 6) == 0) {
+        p += 6;
+        if (*p != '(') {
+            std::cerr << "Unexpected token in options for " << option << "\n";
+            return false;
+        }
+        ++p;
+        char *end = p;
+        while (*end != '\0' && *end != ')') ++end;
+        if (*end != ')') {
+            std::cerr << "Unexpected token in options for " << option << "\n";
+            return false;
+        }
+        *end = '\0';
+        fields.push_back(CSVField(DataType::STRING, atoi(p)));
+    }
+    else if (strncmp(p, "mysql_datetime", 14) == 0) {
+        fields.push_back(CSVField(DataType::MYSQL_DATETIME));
+    }
+    else if (strncmp(p, "mysql_date", 10) == 0) {
+        fields.push_back(CSVField(DataType::MYSQL_DATE));
+    }
+    else {
+        std::cerr << "Invalid column type '" << p << "' for " << option << "\n";
+        return false;
+    }
+
+    return true;
+}
+
 bool parseArguments(int argc, char **argv) {
     for (int i = 0; i < argc; ++i) {
         if (strcmp(argv[i], "--db") == 0) {
@@ -96,11 +260,51 @@ bool parseArguments(int argc, char **argv) {
             if (i == argc) return false;
             args.threads = atoi(argv[i]);
         }
+        else if (strcmp(argv[i], "--connections-per-thread") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.connectionsPerThread = (size_t) atoi(argv[i]);
+            if (args.connectionsPerThread == 0) {
+                std::cerr << "Option --connections-per-thread must be at least 1\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--readers") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.readers = atoi(argv[i]);
+        }
+        else if (strcmp(argv[i], "--parsers") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.parsers = atoi(argv[i]);
+        }
+        else if (strcmp(argv[i], "--block-queue-depth") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.blockQueueDepth = (size_t) atoi(argv[i]);
+            if (args.blockQueueDepth == 0) {
+                std::cerr << "Option --block-queue-depth must be at least 1\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--chunk-queue-depth") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.chunkQueueDepth = (size_t) atoi(argv[i]);
+            if (args.chunkQueueDepth == 0) {
+                std::cerr << "Option --chunk-queue-depth must be at least 1\n";
+                return false;
+            }
+        }
         else if (strcmp(argv[i], "--memory") == 0) {
             ++i;
             if (i == argc) return false;
             args.maxMemory = (size_t) atoi(argv[i]) * MB;
         }
+        else if (strcmp(argv[i], "--hugepages") == 0) {
+            args.hugePages = true;
+        }
         else if (strcmp(argv[i], "--duration") == 0) {
             ++i;
             if (i == argc) return false;
@@ -123,65 +327,78 @@ bool parseArguments(int argc, char **argv) {
             p = strtok(nullptr, ",");
             std::vector<CSVField> fields;
             while (p != nullptr) {
+                if (! parseField(p, fields, "--load-csv")) return false;
 
-                if (strncmp(p, "uint8", 5) == 0) {
-                    fields.push_back(CSVField(DataType::UINT8));
-                }
-                else if (strncmp(p, "uint16", 6) == 0) {
-                    fields.push_back(CSVField(DataType::UINT16));
-                }
-                else if (strncmp(p, "uint32", 6) == 0) {
-                    fields.push_back(CSVField(DataType::UINT32));
-                }
-                else if (strncmp(p, "uint64", 6) == 0) {
-                    fields.push_back(CSVField(DataType::UINT64));
-                }
-                else if (strncmp(p, "int8", 4) == 0) {
-                    fields.push_back(CSVField(DataType::INT8));
-                }
-                else if (strncmp(p, "int16", 5) == 0) {
-                    fields.push_back(CSVField(DataType::INT16));
-                }
-                else if (strncmp(p, "int32", 5) == 0) {
-                    fields.push_back(CSVField(DataType::INT32));
-                }
-                else if (strncmp(p, "int64", 5) == 0) {
-                    fields.push_back(CSVField(DataType::INT64));
-                }
-                else if (strncmp(p, "float32", 7) == 0) {
-                    fields.push_back(CSVField(DataType::FLOAT32));
-                }
-                else if (strncmp(p, "float64", 7) == 0) {
-                    fields.push_back(CSVField(DataType::FLOAT64));
-                }
-                else if (strncmp(p, "string", 6) == 0) {
-                    p += 6;
-                    if (*p != '(') {
-                        std::cerr << "Unexpected token in options for --load-csv\n";
-                        return false;
-                    }
-                    ++p;
-                    char *end = p;
-                    while (*end != '\0' && *end != ')') ++end;
-                    if (*end != ')') {
-                        std::cerr << "Unexpected token in options for --load-csv\n";
-                        return false;
-                    }
-                    *end = '\0';
-                    fields.push_back(CSVField(DataType::STRING, atoi(p)));
-                }
-                else if (strncmp(p, "mysql_date", 7) == 0) {
-                    fields.push_back(CSVField(DataType::MYSQL_DATE));
+                p = strtok(nullptr, ",");
+            }
+
+            args.csvOptions = new CSVOptions(fields);
+        }
+        else if (strcmp(argv[i], "--generate") == 0) {
+            args.generate = true;
+
+            ++i;
+            if (i == argc) return false;
+            auto opt = strdup(argv[i]);
+
+            auto p = strtok(opt, ":");
+            if (p == nullptr || atoll(p) <= 0)  {
+                std::cerr << "Invalid option '" << argv[i] << "' for --generate\n";
+                return false;
+            }
+            args.generateRows = strtoull(p, nullptr, 10);
+
+            std::vector<CSVField> fields;
+            std::vector<char *> specs;
+
+            p = strtok(nullptr, ",");
+            while (p != nullptr) {
+                // a column is a type with an optional =distribution
+                auto spec = strchr(p, '=');
+                if (spec != nullptr) *spec++ = '\0';
+
+                if (! parseField(p, fields, "--generate")) return false;
+                specs.push_back(spec);
+
+                p = strtok(nullptr, ",");
+            }
+
+            if (fields.empty()) {
+                std::cerr << "No columns specified for --generate\n";
+                return false;
+            }
+
+            for (size_t j = 0; j < fields.size(); ++j) {
+                try {
+                    args.distributions.push_back(specs[j] == nullptr
+                        ? ColumnDistribution::defaultFor(fields[j])
+                        : ColumnDistribution::parse(specs[j], fields[j])
+                    );
                 }
-                else {
-                    std::cerr << "Invalid CSV column type '" << p << "'\n";
+                catch (const std::exception &e) {
+                    std::cerr << e.what() << "\n";
                     return false;
                 }
-
-                p = strtok(nullptr, ",");
             }
 
             args.csvOptions = new CSVOptions(fields);
+            args.csvOptions->stringFill = DataGenerator::stringFill(*args.csvOptions, args.distributions);
+        }
+        else if (strcmp(argv[i], "--convert") == 0) {
+            if (! args.loadCsv && ! args.generate) {
+                std::cerr << "Option --convert must follow a --load-csv or a --generate option\n";
+                return false;
+            }
+
+            ++i;
+            if (i == argc) return false;
+            args.convertPath = argv[i];
+        }
+        else if (strcmp(argv[i], "--load-bin") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.loadBin = true;
+            args.binPath = argv[i];
         }
         else if (strcmp(argv[i], "--csv-delimiter") == 0) {
             if (! args.loadCsv) {
@@ -201,18 +418,197 @@ bool parseArguments(int argc, char **argv) {
 
             args.csvOptions->header = false;
         }
+        else if (strcmp(argv[i], "--csv-string-fill") == 0) {
+            if (! args.loadCsv) {
+                std::cerr << "Option --csv-string-fill must follow a --load-csv option\n";
+                return false;
+            }
+
+            ++i;
+            if (i == argc) return false;
+            args.csvOptions->stringFill = atof(argv[i]);
+            if (args.csvOptions->stringFill <= 0 || args.csvOptions->stringFill > 1) {
+                std::cerr << "Option --csv-string-fill must be in (0, 1]\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--csv-mmap") == 0) {
+            if (! args.loadCsv) {
+                std::cerr << "Option --csv-mmap must follow a --load-csv option\n";
+                return false;
+            }
+
+            args.csvOptions->mmap = true;
+        }
+        else if (strcmp(argv[i], "--csv-mmap-populate") == 0) {
+            if (! args.loadCsv) {
+                std::cerr << "Option --csv-mmap-populate must follow a --load-csv option\n";
+                return false;
+            }
+
+            args.csvOptions->mmap = true;
+            args.csvOptions->populate = true;
+        }
+        else if (strcmp(argv[i], "--load-method") == 0) {
+            ++i;
+            if (i == argc) return false;
+            if (strcmp(argv[i], "stmt") == 0) {
+                args.loadOptions.method = LoadMethod::STMT;
+            }
+            else if (strcmp(argv[i], "multirow") == 0) {
+                args.loadOptions.method = LoadMethod::MULTIROW;
+            }
+            else if (strcmp(argv[i], "infile") == 0) {
+                args.loadOptions.method = LoadMethod::INFILE;
+            }
+            else {
+                std::cerr << "Unsupported load method '" << argv[i] << "'\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--batch-rows") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.loadOptions.batchRows = (size_t) atoi(argv[i]);
+            if (args.loadOptions.batchRows == 0) {
+                std::cerr << "Option --batch-rows must be at least 1\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--shard") == 0) {
+            ++i;
+            if (i == argc) return false;
+            try {
+                args.shards.push_back(ShardTarget::parse(argv[i]));
+            }
+            catch (const std::exception &e) {
+                std::cerr << e.what() << "\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--shard-key") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.shardKey = argv[i];
+        }
+        else if (strcmp(argv[i], "--sort-by") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.sortBy = argv[i];
+        }
+        else if (strcmp(argv[i], "--defer-indexes") == 0) {
+            args.deferIndexes = true;
+        }
         else if (strcmp(argv[i], "--run") == 0) {
             ++i;
             if (i == argc) return false;
             args.runQueries = true;
             args.queryPath = argv[i];
         }
+        else if (strcmp(argv[i], "--workload") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.workloadPath = argv[i];
+        }
+        else if (strcmp(argv[i], "--max-retries") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.maxRetries = (size_t) atoi(argv[i]);
+        }
+        else if (strcmp(argv[i], "--iterations") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.iterations = (size_t) atoi(argv[i]);
+            if (args.iterations == 0) {
+                std::cerr << "Option --iterations must be at least 1\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--ramp-up") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.rampUp = atof(argv[i]);
+            if (args.rampUp < 0) {
+                std::cerr << "Option --ramp-up must be a number of seconds\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--warmup") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.warmUp = atof(argv[i]);
+            if (args.warmUp < 0) {
+                std::cerr << "Option --warmup must be a number of seconds\n";
+                return false;
+            }
+        }
         else if (strcmp(argv[i], "--test-query-limit") == 0) {
             args.testQueryLimit = true;
         }
+        else if (strcmp(argv[i], "--protocol") == 0) {
+            ++i;
+            if (i == argc) return false;
+            if (strcmp(argv[i], "text") == 0) {
+                args.prepared = false;
+            }
+            else if (strcmp(argv[i], "prepared") == 0) {
+                args.prepared = true;
+            }
+            else {
+                std::cerr << "Unsupported protocol '" << argv[i] << "'\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.seed = strtoull(argv[i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--rate") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.rate = atof(argv[i]);
+            if (args.rate <= 0) {
+                std::cerr << "Option --rate must be a positive number of queries per second\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--report-interval") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.reportInterval = atof(argv[i]);
+            if (args.reportInterval <= 0) {
+                std::cerr << "Option --report-interval must be a positive number of seconds\n";
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--report-file") == 0) {
+            ++i;
+            if (i == argc) return false;
+            args.reportPath = argv[i];
+
+            auto len = strlen(argv[i]);
+            if (len >= 5 && strcmp(argv[i] + len - 5, ".json") == 0) {
+                args.reportFormat = IntervalReporter::Format::JSON;
+            }
+        }
+        else if (strcmp(argv[i], "--report-format") == 0) {
+            ++i;
+            if (i == argc) return false;
+            if (strcmp(argv[i], "csv") == 0) {
+                args.reportFormat = IntervalReporter::Format::CSV;
+            }
+            else if (strcmp(argv[i], "json") == 0) {
+                args.reportFormat = IntervalReporter::Format::JSON;
+            }
+            else {
+                std::cerr << "Unsupported report format '" << argv[i] << "'\n";
+                return false;
+            }
+        }
         else if (strcmp(argv[i], "--results-file") == 0) {
-            if (! args.runQueries && ! args.testQueryLimit) {
-                std::cerr << "Option --results-file must follow a --run or a --test-query-limit option\n";
+            if (! args.runQueries && ! args.testQueryLimit && args.workloadPath == nullptr) {
+                std::cerr << "Option --results-file must follow a --run, --workload or --test-query-limit option\n";
                 return false;
             }
 
@@ -242,225 +638,1845 @@ bool parseArguments(int argc, char **argv) {
         std::cerr << "No database schema specified\n";
         return false;
     }
-    if (args.loadCsv && args.table == nullptr) {
+    bool sharded = args.shardKey != nullptr;
+    if (args.loadCsv && args.table == nullptr && args.convertPath == nullptr && ! sharded) {
         std::cerr << "No table specified for --load-csv\n";
         return false;
     }
+    if (args.generate && args.table == nullptr && args.convertPath == nullptr && ! sharded) {
+        std::cerr << "No table specified for --generate\n";
+        return false;
+    }
+    if (args.generate && args.loadCsv) {
+        std::cerr << "Option --generate cannot be combined with --load-csv\n";
+        return false;
+    }
+    if (args.loadBin && args.table == nullptr && ! sharded) {
+        std::cerr << "No table specified for --load-bin\n";
+        return false;
+    }
+    if (sharded && args.shards.empty()) {
+        std::cerr << "Option --shard-key needs at least one --shard\n";
+        return false;
+    }
+    if (! sharded && ! args.shards.empty()) {
+        std::cerr << "Option --shard needs a --shard-key\n";
+        return false;
+    }
+    if (args.sortBy != nullptr && ! args.loadCsv && ! args.generate && ! args.loadBin) {
+        std::cerr << "Option --sort-by needs --load-csv, --generate or --load-bin\n";
+        return false;
+    }
+    if (args.deferIndexes && ((! args.loadCsv && ! args.generate && ! args.loadBin) || args.convertPath != nullptr)) {
+        std::cerr << "Option --defer-indexes needs a --load-csv, --generate or --load-bin into tables\n";
+        return false;
+    }
+    if (sharded && args.convertPath != nullptr) {
+        std::cerr << "Option --shard-key cannot be combined with --convert\n";
+        return false;
+    }
+#ifndef HAVE_MYSQL_NONBLOCKING
+    if (args.connectionsPerThread > 1) {
+        std::cerr << "Option --connections-per-thread needs a client library with the non-blocking API of MySQL 8.0.16 or later\n";
+        return false;
+    }
+#endif
+    if (args.connectionsPerThread > 1 && args.rate > 0) {
+        std::cerr << "Option --connections-per-thread cannot be combined with --rate\n";
+        return false;
+    }
+    if (args.connectionsPerThread > 1 && args.prepared) {
+        std::cerr << "Option --connections-per-thread only supports --protocol text\n";
+        return false;
+    }
+    if (args.workloadPath != nullptr && args.rate > 0) {
+        std::cerr << "Option --rate cannot be combined with --workload\n";
+        return false;
+    }
+
+    // a run with neither a duration nor an iteration count makes one pass
+    if (args.iterations == 0 && args.duration == 0) args.iterations = 1;
 
     return true;
 }
 
-void instantiateDB() {
-    if (db != nullptr) return;
-
+/**
+ * Opens a connection to the server at host and port, with the credentials
+ * and schema of the arguments.
+ */
+static Database * connect(const char *host, int port) {
     switch (args.dbType) {
-    case DB::MYSQL: {
-        db = new MySQLDatabase(
-            args.host,
+    case DB::MYSQL:
+        return new MySQLDatabase(
+            host,
             args.user,
             args.password,
             args.database,
-            args.port
+            port,
+            args.loadOptions.method == LoadMethod::INFILE
         );
-        std::unique_lock lk(_connectionsMtx);
-        connections.push_back(db);
-    }
-    break;
 
-    default: break;
+    default:
+        throw RuntimeError("Unsupported database type");
     }
 }
 
+/**
+ * Connects the calling thread to the server at host and port.
+ */
+static void instantiateDB(const char *host, int port) {
+    if (db != nullptr) return;
+
+    db = connect(host, port);
+    std::unique_lock lk(_connectionsMtx);
+    connections.push_back(db);
+}
+
+void instantiateDB() {
+    instantiateDB(args.host, args.port);
+}
+
+/**
+ * Returns the calling thread's progress counters, or null when no progress
+ * is reported.
+ */
+IntervalReporter::Counters * threadCounters() {
+    if (reporter == nullptr) return nullptr;
+    if (counters == nullptr) counters = reporter->counters();
+    return counters;
+}
+
 void closeAllConnections() {
     for (auto c : connections) delete c;
     connections.clear();
 }
 
-void loadCsvData() {
+struct CSVBlock {
+    // a copy, the reader moves on to other files while the block is queued
+    std::string path;
+    const char *begin;
+    const char *end;
+    size_t offset;
 
-    std::cout << "Preparing to load CSV data into table '" << args.table << "'\n";
+    // holds the bytes when they are copied out of a reader's buffer
+    std::vector<char> data;
 
-    ThreadPool pool(args.threads);
+    // keeps the mapping alive when the bytes are read in place
+    std::shared_ptr<CSVReader> reader;
+};
+
+template <typename T>
+static void printQueueStats(
+    const char *name,
+    const BoundedQueue<T> &queue,
+    const char *producer,
+    const char *consumer
+) {
+    std::cout << "  " << name << " queue: depth " << queue.capacity()
+        << ", average occupancy " << queue.averageOccupancy()
+        << ", max " << queue.maxOccupancy()
+        << "; " << producer << " stalled " << queue.pushStalls()
+        << " times (" << queue.pushStallTime() << "s)"
+        << ", " << consumer << " starved " << queue.popStalls()
+        << " times (" << queue.popStallTime() << "s)\n";
+}
+
+/**
+ * Connects the calling loader thread, returning false if it cannot.
+ */
+static bool connectLoader() {
+    try {
+        instantiateDB();
+        return true;
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return false;
+    }
+}
+
+/**
+ * Sets up the --sort-by sorter for chunks of the given fields, throwing if
+ * the key does not fit them.
+ */
+static void openSorter(const std::vector<CSVField> &fields) {
+    if (args.sortBy == nullptr) return;
+
+    sorter = std::make_unique<ChunkSorter>(args.sortBy, fields);
+}
+
+/**
+ * Returns the rows of chunk in key order with --sort-by, in a buffer of the
+ * calling thread that is reused by its next call, or chunk itself.
+ */
+static const ColumnarTableChunk * sortChunk(const ColumnarTableChunk *chunk) {
+    if (! sorter) return chunk;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto sorted = sorter->sort(chunk, sortBuffer);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    sortTime += (end - start).count();
+    ++sortedChunks;
+    if (sorted != chunk) ++reorderedChunks;
+
+    return sorted;
+}
+
+static void printSortStats() {
+    if (! sorter) return;
+
+    std::cout << "  Sorting: " << sortedChunks << " chunks by '" << args.sortBy
+        << "', " << reorderedChunks << " of them out of order, in "
+        << sortTime / 1e9 << "s of loader time\n";
+}
+
+/**
+ * Loads chunk into table through the calling thread's connection, sorted
+ * with --sort-by, returning false if it failed.
+ */
+static bool loadChunk(const ColumnarTableChunk *chunk, const std::string &table) {
+    std::cout << "Loading data chunk ("
+        << chunk->size() << " rows) into table '"
+        << table << "'\n";
+
+    try {
+        auto rows = sortChunk(chunk);
+
+        auto loadStart = std::chrono::high_resolution_clock::now();
+
+        db->loadIntoTable(table, rows, args.loadOptions);
+
+        auto loadEnd = std::chrono::high_resolution_clock::now();
+
+        if (auto c = threadCounters()) {
+            c->query((loadEnd - loadStart).count(), chunk->size());
+        }
+
+        return true;
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        if (auto c = threadCounters()) c->error();
+    }
+    catch (...) {
+        std::cerr << "An unknown exception occurred while loading CSV file\n";
+        if (auto c = threadCounters()) c->error();
+    }
+
+    return false;
+}
+
+/**
+ * Loads the chunks that come out of queue until it is closed and drained,
+ * releasing each one back to chunks.
+ */
+static void loadChunks(BoundedQueue<ColumnarTableChunk *> &queue, ChunkPool &chunks) {
+    bool connected = connectLoader();
+
+    // a loader without a connection still drains its share so the
+    // other stages do not stall on it
+    ColumnarTableChunk *chunk;
+    while (queue.pop(chunk)) {
+        if (connected) loadChunk(chunk, args.table);
+        chunks.release(chunk);
+    }
+}
+
+/**
+ * Writes the chunks that come out of queue to a snapshot instead of loading
+ * them. A failed write is reported and the rest of the chunks are drained.
+ */
+static void writeChunks(
+    BoundedQueue<ColumnarTableChunk *> &queue,
+    ChunkPool &chunks,
+    ColumnarFileWriter &writer
+) {
+    bool failed = false;
+
+    ColumnarTableChunk *chunk;
+    while (queue.pop(chunk)) {
+        if (! failed) {
+            try {
+                writer.write(sortChunk(chunk));
+            }
+            catch (const std::exception &e) {
+                std::cerr << e.what() << "\n";
+                failed = true;
+            }
+        }
+
+        chunks.release(chunk);
+    }
+}
+
+/**
+ * Opens the snapshot the chunks of a --convert run are written to, or
+ * returns null if there is none.
+ */
+static std::unique_ptr<ColumnarFileWriter> openConverter(const CSVOptions &options) {
+    if (args.convertPath == nullptr) return nullptr;
+
+    try {
+        return std::make_unique<ColumnarFileWriter>(args.convertPath, options.fields);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        exit(1);
+    }
+}
+
+static void closeConverter(ColumnarFileWriter &writer) {
+    try {
+        writer.close();
+        std::cout << "Wrote " << writer.rows() << " rows in " << writer.chunks()
+            << " chunks to '" << args.convertPath << "'\n";
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+    }
+}
+
+/**
+ * A target of a sharded load, with its own buffer chunks, queue and pool of
+ * connections.
+ */
+struct Shard {
+    ShardTarget target;
+    std::unique_ptr<ChunkPool> chunks;
+    std::unique_ptr<BoundedQueue<ColumnarTableChunk *>> queue;
+    std::vector<std::thread> loaders;
+
+    std::atomic<uint64_t> rows { 0 };
+    std::atomic<size_t> loaded { 0 };
+};
+
+/**
+ * The shards of a load with --shard-key. The loader threads of the pipeline
+ * become routers: each partitions the chunks it takes by the shard key and
+ * copies the rows of every shard into a buffer chunk of its own for that
+ * shard, which goes to the shard's queue once it is full. Each shard's
+ * connections load the buffers as they come.
+ */
+struct ShardedLoad {
+    ShardRouter router;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    size_t memorySize() const {
+        size_t size = 0;
+        for (const auto &s : shards) {
+            size += s->chunks->memorySize();
+
+            // every connection sorts into a buffer of its own
+            if (args.sortBy != nullptr) size += args.threads * s->chunks->chunkMemorySize();
+        }
+        return size;
+    }
+};
+
+/**
+ * The buffers a router thread is filling, one per shard.
+ */
+struct ShardBuffers {
+    ShardPartition partition;
+    std::vector<ColumnarTableChunk *> chunks;
+    std::vector<size_t> rows;
+};
+
+static void loadShard(Shard &shard) {
+    bool connected;
+    try {
+        instantiateDB(
+            shard.target.host.empty() ? args.host : shard.target.host.c_str(),
+            shard.target.host.empty() ? args.port : shard.target.port
+        );
+        connected = true;
+    }
+    catch (const std::exception &e) {
+        std::cerr << shard.target.name() << ": " << e.what() << "\n";
+        connected = false;
+    }
+
+    ColumnarTableChunk *chunk;
+    while (shard.queue->pop(chunk)) {
+        if (connected && loadChunk(chunk, shard.target.table)) {
+            shard.rows += chunk->size();
+            ++shard.loaded;
+        }
+        shard.chunks->release(chunk);
+    }
+}
+
+/**
+ * Sets up the shards of a --shard-key load fed by the given number of
+ * routers and starts their connections, or returns null if the load is
+ * not sharded. Throws if the key does not fit the fields.
+ */
+static std::unique_ptr<ShardedLoad> openShards(const CSVOptions &options, size_t routers) {
+    if (args.shardKey == nullptr) return nullptr;
+
+    std::unique_ptr<ShardedLoad> load(new ShardedLoad {
+        ShardRouter(args.shardKey, options.fields, args.shards.size()),
+        { }
+    });
+
+    // every router may hold a buffer of each shard while its connections
+    // load one each, and sort one each with --sort-by; all of them together
+    // get half of the memory budget, in chunks no larger than the parsers'
+    // own
+    size_t capacity = routers + args.threads;
+    size_t buffers = capacity + (args.sortBy != nullptr ? args.threads : 0);
+    size_t rows = CSV::rowsPerChunk(options);
+    size_t rowSize = std::max<size_t>(1, ChunkPool::arenaSize(options, rows) / rows);
+    size_t budgetRows = args.maxMemory / 2 / (args.shards.size() * buffers * rowSize);
+    rows = std::max<size_t>(1, std::min(rows, budgetRows));
+
+    for (const auto &target : args.shards) {
+        auto shard = std::make_unique<Shard>();
+        shard->target = target;
+        shard->chunks = std::make_unique<ChunkPool>(options, rows, capacity, args.hugePages);
+        shard->queue = std::make_unique<BoundedQueue<ColumnarTableChunk *>>(args.chunkQueueDepth);
+        load->shards.push_back(std::move(shard));
+    }
+
+    for (auto &shard : load->shards) {
+        for (size_t i = 0; i < args.threads; ++i) {
+            shard->loaders.emplace_back([&s = *shard] { loadShard(s); });
+        }
+    }
+
+    return load;
+}
+
+static void sendShardBuffer(ShardedLoad &load, ShardBuffers &buffers, size_t s) {
+    auto chunk = buffers.chunks[s];
+    buffers.chunks[s] = nullptr;
+
+    for (auto &c : chunk->columns) c.size = buffers.rows[s];
+    load.shards[s]->queue->push(chunk);
+}
+
+/**
+ * Copies the rows of chunk to the buffers of their shards, sending every
+ * buffer that fills up.
+ */
+static void routeChunk(ShardedLoad &load, const ColumnarTableChunk *chunk, ShardBuffers &buffers) {
+    size_t numShards = load.shards.size();
+    buffers.chunks.resize(numShards, nullptr);
+    buffers.rows.resize(numShards, 0);
+
+    load.router.partition(chunk, buffers.partition);
+    const auto &p = buffers.partition;
+
+    for (size_t s = 0; s < numShards; ++s) {
+        auto &shard = *load.shards[s];
+        const uint32_t *rows = p.rows.data() + p.begins[s];
+        size_t n = p.begins[s + 1] - p.begins[s];
+
+        while (n > 0) {
+            if (buffers.chunks[s] == nullptr) {
+                buffers.chunks[s] = shard.chunks->acquire();
+                buffers.rows[s] = 0;
+            }
+
+            size_t k = load.router.gather(
+                buffers.chunks[s],
+                buffers.rows[s],
+                shard.chunks->rows(),
+                chunk,
+                rows,
+                n
+            );
+            if (k == 0 && buffers.rows[s] == 0) {
+                throw RuntimeError("A row does not fit in a shard buffer");
+            }
+
+            buffers.rows[s] += k;
+            rows += k;
+            n -= k;
+
+            // a buffer that takes fewer rows than it is offered is full
+            if (n > 0 || buffers.rows[s] == shard.chunks->rows()) sendShardBuffer(load, buffers, s);
+        }
+    }
+}
+
+/**
+ * Sends the partly filled buffers of a router that has run out of chunks.
+ */
+static void flushShards(ShardedLoad &load, ShardBuffers &buffers) {
+    for (size_t s = 0; s < buffers.chunks.size(); ++s) {
+        if (buffers.chunks[s] == nullptr) continue;
+
+        if (buffers.rows[s] > 0) sendShardBuffer(load, buffers, s);
+        else load.shards[s]->chunks->release(buffers.chunks[s]);
+    }
+}
+
+/**
+ * Routes the chunks that come out of queue until it is closed and drained,
+ * releasing each one back to chunks.
+ */
+static void routeChunks(
+    BoundedQueue<ColumnarTableChunk *> &queue,
+    ChunkPool &chunks,
+    ShardedLoad &load
+) {
+    ShardBuffers buffers;
+
+    ColumnarTableChunk *chunk;
+    while (queue.pop(chunk)) {
+        try {
+            routeChunk(load, chunk, buffers);
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+        }
+        chunks.release(chunk);
+    }
+
+    flushShards(load, buffers);
+}
+
+/**
+ * Waits for the shards to load what the routers, which must have finished,
+ * sent them.
+ */
+static void closeShards(ShardedLoad &load) {
+    for (auto &shard : load.shards) shard->queue->close();
+    for (auto &shard : load.shards) {
+        for (auto &t : shard->loaders) t.join();
+    }
+}
+
+static void printShardStats(const ShardedLoad &load) {
+    for (size_t s = 0; s < load.shards.size(); ++s) {
+        const auto &shard = *load.shards[s];
+        std::cout << "  Shard " << s << " (" << shard.target.name() << "): "
+            << shard.rows << " rows in " << shard.loaded << " chunks of up to "
+            << shard.chunks->rows() << " rows; routers waited for a free buffer "
+            << shard.chunks->waits() << " times\n";
+    }
+}
+
+/**
+ * What a load goes into, for messages.
+ */
+static std::string loadTarget() {
+    if (args.shardKey != nullptr) return std::to_string(args.shards.size()) + " shards";
+    return std::string("table '") + args.table + "'";
+}
+
+void loadCsvData() {
+
+    const auto &options = *args.csvOptions;
+
+    // a conversion has a single loader, which writes the snapshot
+    auto writer = openConverter(options);
+
+    if (writer) {
+        std::cout << "Preparing to convert CSV data into '" << args.convertPath << "'\n";
+    }
+    else {
+        std::cout << "Preparing to load CSV data into " << loadTarget() << "\n";
+    }
+
+    size_t readers = std::max<size_t>(args.readers, 1);
+    size_t parsers = args.parsers == 0 ? args.threads : args.parsers;
+    size_t loaders = writer ? 1 : args.threads;
+
+    openSorter(options.fields);
+    auto sharded = openShards(options, loaders);
+    size_t shardMemory = sharded ? sharded->memorySize() : 0;
+
+    auto files = File::list(args.csvPath);
+
+    // compressed files are read into blocks even with --csv-mmap
+    bool buffered = ! options.mmap;
+    for (const auto &p : files) {
+        if (CompressedInput::detect(p.get()) != Compression::NONE) buffered = true;
+    }
+
+    // every parser and reader may hold a block on top of a full queue
+    size_t numBlocks = args.blockQueueDepth + parsers + readers;
+    size_t blockMemory = buffered ? numBlocks * options.blockSize : 0;
+
+    // chunks get what is left of the memory budget, and at least one
+    size_t rows = CSV::rowsPerChunk(options);
+    size_t used = blockMemory + shardMemory;
+
+    // loaders that sort hold a sorted copy of the chunk they load
+    if (sorter && ! sharded) used += loaders * ChunkPool::arenaSize(options, rows);
+
+    size_t chunkBudget = args.maxMemory > used ? args.maxMemory - used : 0;
+    ChunkPool chunks(
+        options,
+        rows,
+        chunkBudget / ChunkPool::arenaSize(options, rows),
+        args.hugePages
+    );
+
+    std::vector<CSVBlock> blocks(numBlocks);
+    BoundedQueue<CSVBlock *> freeBlocks(numBlocks);
+    for (auto &b : blocks) freeBlocks.push(&b);
+
+    BoundedQueue<CSVBlock *> blockQueue(args.blockQueueDepth);
+    BoundedQueue<ColumnarTableChunk *> chunkQueue(args.chunkQueueDepth);
+
+    std::vector<std::string> paths;
+    for (const auto &p : files) paths.push_back(p.get());
+    IngestScheduler scheduler(paths, readers, options.blockSize);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> readerThreads, parserThreads, loaderThreads;
+
+    for (size_t i = 0; i < loaders; ++i) {
+        loaderThreads.emplace_back([&] {
+            if (writer) writeChunks(chunkQueue, chunks, *writer);
+            else if (sharded) routeChunks(chunkQueue, chunks, *sharded);
+            else loadChunks(chunkQueue, chunks);
+        });
+    }
+
+    for (size_t i = 0; i < parsers; ++i) {
+        parserThreads.emplace_back([&] {
+            CSVParser parser(options, &chunks);
+
+            CSVBlock *block;
+            while (blockQueue.pop(block)) {
+                parser.setInput(block->begin, block->end, block->path.c_str(), block->offset);
+
+                try {
+                    while (auto chunk = parser.parse()) chunkQueue.push(chunk);
+                }
+                catch (const std::exception &e) {
+                    std::cerr << e.what() << "\n";
+                }
+
+                block->reader.reset();
+                freeBlocks.push(block);
+            }
+
+            if (auto chunk = parser.flush()) chunkQueue.push(chunk);
+        });
+    }
+
+    for (size_t i = 0; i < readers; ++i) {
+        readerThreads.emplace_back([&, i] {
+            CSVWork item;
+            while (scheduler.next(i, item)) {
+                if (item.range.begin == 0) {
+                    std::cout << "Reading file " << item.path << '\n';
+                }
+
+                try {
+                    auto reader = std::make_shared<CSVReader>(
+                        item.path.c_str(),
+                        options,
+                        item.range
+                    );
+
+                    const char *begin, *end;
+                    size_t offset;
+                    while (reader->nextBlock(begin, end, offset)) {
+                        CSVBlock *block;
+                        freeBlocks.pop(block);
+
+                        if (reader->mapped()) {
+                            block->begin = begin;
+                            block->end = end;
+                            block->reader = reader;
+                        }
+                        else {
+                            block->data.assign(begin, end);
+                            block->begin = block->data.data();
+                            block->end = block->begin + block->data.size();
+                        }
+                        block->path = item.path;
+                        block->offset = offset;
+
+                        blockQueue.push(block);
+                    }
+                }
+                catch (const std::exception &e) {
+                    std::cerr << e.what() << "\n";
+                }
+            }
+        });
+    }
+
+    // each stage ends once the stage feeding it has finished and its queue
+    // has drained
+    for (auto &t : readerThreads) t.join();
+    blockQueue.close();
+    for (auto &t : parserThreads) t.join();
+    chunkQueue.close();
+    for (auto &t : loaderThreads) t.join();
+    if (sharded) closeShards(*sharded);
+
+    closeAllConnections();
+    if (writer) closeConverter(*writer);
+
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Finished data loading in " << (loadEnd - start).count() / 1e9 << "\n";
+
+    std::cout << "Pipeline: " << readers << " readers, " << parsers
+        << " parsers, " << loaders << (sharded ? " routers\n" : " loaders\n");
+    std::cout << "  Files: " << scheduler.files() << " (" << scheduler.bytes()
+        << " bytes) in " << scheduler.slices() << " slices; readers stole "
+        << scheduler.steals() << " slices\n";
+    printQueueStats("Block", blockQueue, "readers", "parsers");
+    printQueueStats("Chunk", chunkQueue, "parsers", sharded ? "routers" : "loaders");
+    std::cout << "  Chunk pool: " << chunks.capacity() << " chunks of "
+        << chunks.rows() << " rows; parsers waited for a free chunk "
+        << chunks.waits() << " times\n";
+    if (sharded) printShardStats(*sharded);
+    printSortStats();
+}
+
+void generateData() {
+
+    const auto &options = *args.csvOptions;
+    DataGenerator generator(args.distributions, args.seed);
+
+    auto writer = openConverter(options);
+
+    std::cout << "Preparing to generate " << args.generateRows << " rows into ";
+    if (writer) std::cout << "'" << args.convertPath << "'";
+    else std::cout << loadTarget();
+    std::cout << " with seed " << args.seed << "\n";
+
+    size_t generators = args.parsers == 0 ? args.threads : args.parsers;
+    size_t loaders = writer ? 1 : args.threads;
+
+    openSorter(options.fields);
+    auto sharded = openShards(options, loaders);
+
+    size_t rows = CSV::rowsPerChunk(options);
+    size_t used = sharded ? sharded->memorySize() : 0;
+    if (sorter && ! sharded) used += loaders * ChunkPool::arenaSize(options, rows);
+
+    ChunkPool chunks(
+        options,
+        rows,
+        (args.maxMemory > used ? args.maxMemory - used : 0) / ChunkPool::arenaSize(options, rows),
+        args.hugePages
+    );
+
+    BoundedQueue<ColumnarTableChunk *> chunkQueue(args.chunkQueueDepth);
+
+    // generators claim row ranges of one chunk each
+    uint64_t numChunks = (args.generateRows + rows - 1) / rows;
+    std::atomic<uint64_t> nextChunk(0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> generatorThreads, loaderThreads;
+
+    for (size_t i = 0; i < loaders; ++i) {
+        loaderThreads.emplace_back([&] {
+            if (writer) writeChunks(chunkQueue, chunks, *writer);
+            else if (sharded) routeChunks(chunkQueue, chunks, *sharded);
+            else loadChunks(chunkQueue, chunks);
+        });
+    }
+
+    for (size_t i = 0; i < generators; ++i) {
+        generatorThreads.emplace_back([&] {
+            for (uint64_t c = nextChunk++; c < numChunks; c = nextChunk++) {
+                uint64_t firstRow = c * rows;
+                size_t n = std::min<uint64_t>(rows, args.generateRows - firstRow);
+
+                auto chunk = chunks.acquire();
+                generator.fill(chunk, firstRow, n);
+                chunkQueue.push(chunk);
+            }
+        });
+    }
+
+    for (auto &t : generatorThreads) t.join();
+    chunkQueue.close();
+    for (auto &t : loaderThreads) t.join();
+    if (sharded) closeShards(*sharded);
+
+    closeAllConnections();
+    if (writer) closeConverter(*writer);
+
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Finished data loading in " << (loadEnd - start).count() / 1e9 << "\n";
+
+    std::cout << "Pipeline: " << generators << " generators, " << loaders
+        << (sharded ? " routers\n" : " loaders\n");
+    printQueueStats("Chunk", chunkQueue, "generators", sharded ? "routers" : "loaders");
+    std::cout << "  Chunk pool: " << chunks.capacity() << " chunks of "
+        << chunks.rows() << " rows; generators waited for a free chunk "
+        << chunks.waits() << " times\n";
+    if (sharded) printShardStats(*sharded);
+    printSortStats();
+}
+
+/**
+ * Returns the fields of the snapshots, or none if there are none, throwing
+ * if they differ, since routing and sorting need the same fields in every
+ * one.
+ */
+static std::vector<CSVField> snapshotFields(const std::vector<std::unique_ptr<ColumnarFile>> &files) {
+    if (files.empty()) return { };
+
+    const auto &fields = files.front()->fields();
+    for (const auto &f : files) {
+        bool same = f->fields().size() == fields.size();
+        for (size_t j = 0; same && j < fields.size(); ++j) {
+            same = f->fields()[j].type == fields[j].type && f->fields()[j].size == fields[j].size;
+        }
+        if (! same) throw RuntimeError("Snapshots of a sharded or sorted load must all have the same fields");
+    }
+
+    return fields;
+}
+
+/**
+ * Maps the snapshots of --load-bin, reporting them and the ones that cannot
+ * be mapped if verbose.
+ */
+static std::vector<std::unique_ptr<ColumnarFile>> mapSnapshots(bool verbose) {
+    std::vector<std::unique_ptr<ColumnarFile>> files;
+    for (const auto &p : File::list(args.binPath)) {
+        try {
+            files.push_back(std::make_unique<ColumnarFile>(p.get()));
+            if (verbose) {
+                std::cout << "Mapped file " << p.get() << " (" << files.back()->rows()
+                    << " rows in " << files.back()->chunks() << " chunks)\n";
+            }
+        }
+        catch (const std::exception &e) {
+            if (verbose) std::cerr << e.what() << "\n";
+        }
+    }
+    return files;
+}
+
+void loadBinData() {
+
+    std::cout << "Preparing to load columnar snapshots into " << loadTarget() << "\n";
+
+    auto files = mapSnapshots(true);
+
+    std::unique_ptr<ShardedLoad> sharded;
+    if ((args.shardKey != nullptr || args.sortBy != nullptr) && ! files.empty()) {
+        auto fields = snapshotFields(files);
+        openSorter(fields);
+        sharded = openShards(CSVOptions(fields), args.threads);
+    }
+
+    // loaders take chunks of every file in turn, straight out of the mapping
+    std::vector<std::pair<const ColumnarFile *, size_t>> work;
+    for (const auto &f : files) {
+        for (size_t i = 0; i < f->chunks(); ++i) work.push_back({ f.get(), i });
+    }
+    std::atomic<size_t> nextWork(0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> loaderThreads;
+    for (size_t i = 0; i < args.threads; ++i) {
+        loaderThreads.emplace_back([&] {
+            if (sharded) {
+                ShardBuffers buffers;
+                for (size_t w = nextWork++; w < work.size(); w = nextWork++) {
+                    std::unique_ptr<ColumnarTableChunk> chunk(work[w].first->chunk(work[w].second));
+                    try {
+                        routeChunk(*sharded, chunk.get(), buffers);
+                    }
+                    catch (const std::exception &e) {
+                        std::cerr << e.what() << "\n";
+                    }
+                }
+                flushShards(*sharded, buffers);
+                return;
+            }
+
+            if (! connectLoader()) return;
+
+            for (size_t w = nextWork++; w < work.size(); w = nextWork++) {
+                std::unique_ptr<ColumnarTableChunk> chunk(work[w].first->chunk(work[w].second));
+                loadChunk(chunk.get(), args.table);
+            }
+        });
+    }
+
+    for (auto &t : loaderThreads) t.join();
+    if (sharded) closeShards(*sharded);
+
+    closeAllConnections();
+
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Finished data loading in " << (loadEnd - start).count() / 1e9 << "\n";
+    if (sharded) printShardStats(*sharded);
+    printSortStats();
+}
+
+/**
+ * Checks --sort-by and --shard-key against the fields of every load of the
+ * run, which for --load-bin are only known once its snapshots are mapped,
+ * throwing if they do not fit. Done before anything is changed on the
+ * server, since a load that fails on its options would leave the indexes
+ * of --defer-indexes dropped.
+ */
+static void checkLoadKeys() {
+    if (args.sortBy == nullptr && args.shardKey == nullptr) return;
+
+    std::vector<std::vector<CSVField>> loads;
+    if (args.loadCsv || args.generate) loads.push_back(args.csvOptions->fields);
+    if (args.loadBin) loads.push_back(snapshotFields(mapSnapshots(false)));
+
+    // a sorter and a router are built only to see that they can be
+    for (const auto &fields : loads) {
+        if (fields.empty()) continue;
+        if (args.sortBy != nullptr) ChunkSorter(args.sortBy, fields);
+        if (args.shardKey != nullptr) ShardRouter(args.shardKey, fields, args.shards.size());
+    }
+}
+
+/**
+ * The tables a load goes into: the targets of --shard, or --table on the
+ * server of --host.
+ */
+static std::vector<ShardTarget> loadTargets() {
+    if (args.shardKey != nullptr) return args.shards;
+
+    ShardTarget target;
+    target.table = args.table;
+    return { target };
+}
+
+/**
+ * Runs f for every target at once, each in a thread of its own with a
+ * connection of its own. Errors are reported with the target they occurred
+ * on and make f count as failed there; returns which targets succeeded.
+ */
+static std::vector<bool> forEachTarget(
+    const std::vector<ShardTarget> &targets,
+    const std::function<void(size_t, Database &)> &f
+) {
+    std::vector<char> succeeded(targets.size(), false);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        threads.emplace_back([&, i] {
+            const auto &target = targets[i];
+            try {
+                std::unique_ptr<Database> conn(connect(
+                    target.host.empty() ? args.host : target.host.c_str(),
+                    target.host.empty() ? args.port : target.port
+                ));
+                f(i, *conn);
+                succeeded[i] = true;
+            }
+            catch (const std::exception &e) {
+                std::cerr << target.name() << ": " << e.what() << "\n";
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+
+    return std::vector<bool>(succeeded.begin(), succeeded.end());
+}
+
+/**
+ * The indexes dropped from the tables of a load with --defer-indexes.
+ */
+struct IndexDeferral {
+    std::vector<ShardTarget> targets;
+
+    // the indexes of each target, of which only those of the targets whose
+    // drop succeeded are to be added back
+    std::vector<std::unique_ptr<DeferredIndexes>> indexes;
+    std::vector<bool> dropped;
+
+    std::chrono::high_resolution_clock::time_point start;
+    std::chrono::high_resolution_clock::time_point loadStart;
+};
+
+/**
+ * Drops the deferrable secondary indexes of every table the load goes into,
+ * after printing their definitions so that they can be recreated by hand
+ * should the load never finish. Returns null without --defer-indexes.
+ */
+static std::unique_ptr<IndexDeferral> deferIndexes() {
+    if (! args.deferIndexes) return nullptr;
+
+    auto deferral = std::make_unique<IndexDeferral>();
+    deferral->targets = loadTargets();
+    deferral->indexes.resize(deferral->targets.size());
+    deferral->start = std::chrono::high_resolution_clock::now();
+
+    auto read = forEachTarget(deferral->targets, [&](size_t i, Database &conn) {
+        const auto &table = deferral->targets[i].table;
+        auto rows = conn.fetch("SHOW CREATE TABLE " + table);
+        if (rows.size() != 1 || rows[0].size() < 2) {
+            throw DynamicMessageError(("No definition of table '" + table + "'").c_str());
+        }
+
+        deferral->indexes[i] = std::make_unique<DeferredIndexes>(table, rows[0][1]);
+    });
+
+    // nothing is dropped unless every definition could be read
+    if (std::find(read.begin(), read.end(), false) != read.end()) exit(1);
+
+    for (const auto &indexes : deferral->indexes) {
+        std::cout << "Deferring " << indexes->indexes().size() << " indexes of table '"
+            << indexes->table() << "'\n";
+        for (const auto &index : indexes->indexes()) {
+            std::cout << "  " << index.definition << "\n";
+        }
+    }
+
+    deferral->dropped = forEachTarget(deferral->targets, [&](size_t i, Database &conn) {
+        const auto &indexes = *deferral->indexes[i];
+        if (! indexes.indexes().empty()) conn.query(indexes.dropStatement());
+    });
+
+    deferral->loadStart = std::chrono::high_resolution_clock::now();
+    return deferral;
+}
+
+/**
+ * Adds the indexes of a --defer-indexes load back once it has finished.
+ * Each table gets them all in a single ALTER TABLE, which scans it once,
+ * and the tables of a sharded load are built in parallel; ALTER TABLEs of
+ * the same table would only wait for each other's metadata lock.
+ */
+static void restoreIndexes(IndexDeferral &deferral) {
+    auto rebuildStart = std::chrono::high_resolution_clock::now();
+
+    auto rebuilt = forEachTarget(deferral.targets, [&](size_t i, Database &conn) {
+        const auto &indexes = *deferral.indexes[i];
+        if (! deferral.dropped[i] || indexes.indexes().empty()) return;
+
+        std::cout << "Building " << indexes.indexes().size() << " indexes of table '"
+            << indexes.table() << "'\n";
+        conn.query(indexes.addStatement());
+    });
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < rebuilt.size(); ++i) {
+        if (! rebuilt[i]) {
+            std::cerr << "Indexes of table '" << deferral.indexes[i]->table()
+                << "' were not rebuilt, they are:\n  "
+                << deferral.indexes[i]->addStatement() << "\n";
+        }
+    }
+
+    std::cout << "Deferred indexes: dropped in " << (deferral.loadStart - deferral.start).count() / 1e9
+        << "s, loaded in " << (rebuildStart - deferral.loadStart).count() / 1e9
+        << "s, rebuilt in " << (end - rebuildStart).count() / 1e9
+        << "s, " << (end - deferral.start).count() / 1e9 << "s in all\n";
+}
+
+List<std::string> * readQueries(const Path &path) {
+    auto queries = new List<std::string>();
+    
+    File f(path);
+    auto buf = new char[f.info().length() + 1];
+    f.read(buf, f.info().length());
+
+    std::stringstream s;
+
+    auto p = buf;
+    while (*p != '\0') {
+        // ignore empty lines
+        while (*p == '\n') ++p;
+
+        // ignore lines starting with --
+        if (strncmp(p, "--", 2) == 0) {
+            while (*p != '\0' && *p != '\n') ++p;
+            continue;
+        }
+
+        while (*p != '\0' && *p != '\n' && *p != ';') {
+            s << *p;
+            ++p;
+        }
+        if (*p == '\n') {
+            s << *p;
+            ++p;
+        }
+        else if (*p == ';') {
+            ++p;
+            queries->append(s.str());
+            s = std::stringstream();
+        }
+    }
+
+    delete[] buf;
+
+    return queries;
+}
+
+static void printSchedule(const RateSchedule &schedule, const LatencyHistogram &service) {
+    std::cout << "Offered " << schedule.rate() << " queries per second: "
+        << schedule.issued() << " sent, " << schedule.late()
+        << " sent late, " << schedule.dropped() << " dropped\n";
+
+    std::cout << "Service time (excluding time behind schedule): ";
+    service.print(std::cout);
+    std::cout << "\n";
+}
+
+/**
+ * Prints the throughput and latency of every phase of a run that has more
+ * than the measured one.
+ */
+static void printPhases(
+    const RunPhases &phases,
+    const std::vector<LatencyHistogram> &latency,
+    RunPhases::Clock::time_point end,
+    const char *unit
+) {
+    if (! phases.staged()) return;
+
+    for (size_t j = 0; j < RunPhases::COUNT; ++j) {
+        auto phase = (RunPhases::Phase) j;
+        double seconds = phases.seconds(phase, end);
+
+        std::cout << "Phase " << RunPhases::name(phase) << ": "
+            << latency[j].count() << " " << unit << " in " << seconds << " seconds ("
+            << (seconds > 0 ? latency[j].count() / seconds : 0)
+            << " per second), latency: ";
+        latency[j].print(std::cout);
+        std::cout << "\n";
+    }
+}
+
+static void writePhases(
+    std::ostream &out,
+    const RunPhases &phases,
+    const std::vector<LatencyHistogram> &latency
+) {
+    if (! phases.staged()) return;
+
+    for (size_t j = 0; j < RunPhases::COUNT; ++j) {
+        latency[j].writeCSV(out, "phase", RunPhases::name((RunPhases::Phase) j));
+    }
+}
+
+void runQueries() {
+    std::cout << "Preparing to run benchmark queries\n";
+
+    size_t queryCount = 0;
+
+    auto files = File::list(args.queryPath);
+
+    std::vector<std::string> streamNames;
+
+    // placeholders are compiled here, so that running a query only has to
+    // draw its values
+    std::vector<std::vector<QueryTemplate>> templates;
+    QueryTemplate::ChoiceFiles choiceFiles;
+
+    for (const auto &p : files) {
+        std::cout << "Reading query file " << p.get() << "\n";
+
+        auto queries = readQueries(p);
+        queryCount += queries->size();
+        streamNames.push_back(p.get());
+
+        std::string directory = p.get();
+        auto slash = directory.find_last_of('/');
+        directory.resize(slash == std::string::npos ? 0 : slash);
+
+        templates.emplace_back();
+        templates.back().reserve(queries->size());
+        try {
+            for (const auto &q : *queries) {
+                templates.back().emplace_back(q, directory, choiceFiles);
+            }
+        }
+        catch (const std::exception &e) {
+            std::cerr << p.get() << ": " << e.what() << "\n";
+            exit(1);
+        }
+
+        delete queries;
+    }
+
+    // a closed-loop stream holds its thread until the run is over, so with a
+    // duration a stream without a thread of its own would never run
+    if (args.rate == 0 && args.duration > 0 && templates.size() > args.threads) {
+        std::cerr << "A --duration run of " << templates.size()
+            << " query streams needs --threads " << templates.size() << " or more\n";
+        exit(1);
+    }
+
+    std::cout << "Generating query values with seed " << args.seed << "\n";
+
+    RunPhases phases(args.rampUp, args.warmUp, args.duration);
+
+    // each stream records into its own histograms, which are merged into
+    // these when it finishes; the stream and query histograms only hold the
+    // measured phase
+    std::mutex latencyMtx;
+    std::vector<LatencyHistogram> phaseLatency(RunPhases::COUNT);
+    auto &latency = phaseLatency[(size_t) RunPhases::Phase::MEASURED];
+    std::vector<LatencyHistogram> streamLatency(templates.size());
+    std::map<std::string, LatencyHistogram> queryLatency;
+
+    // only kept by open-loop runs, as the time from send to reply
+    LatencyHistogram serviceLatency;
+
+    ThreadPool pool(args.threads);
     SynchronizationCondition tasks;
-    SynchronizationCondition memory(args.maxMemory);
 
-    auto files = File::list(args.csvPath);
+    std::unique_ptr<RateSchedule> schedule;
 
-    auto start = std::chrono::high_resolution_clock::now();
+    if (args.rate > 0) {
+        std::cout << "Running " << templates.size() << " query streams at "
+            << args.rate << " queries per second using " << args.threads << " threads\n";
 
-    for (const auto &p : files) {
-        memory.wait();
-        PathInfo pInfo(p);
-        memory.increase(pInfo.length());
+        // the streams are interleaved into one timetable, so they all
+        // advance at the same pace
+        std::vector<std::pair<size_t, const QueryTemplate *>> timetable;
+        for (size_t k = 0; timetable.size() < queryCount; ++k) {
+            for (size_t i = 0; i < templates.size(); ++i) {
+                if (k < templates[i].size()) timetable.push_back({ i, &templates[i][k] });
+            }
+        }
+
+        // parameters are taken out of the queries before the run starts,
+        // except from generated ones, whose text changes every time
+        std::vector<std::unique_ptr<ParameterizedQuery>> parameterized(timetable.size());
+        if (args.prepared) {
+            for (size_t k = 0; k < timetable.size(); ++k) {
+                const auto *t = timetable[k].second;
+                if (! t->generated()) parameterized[k] = std::make_unique<ParameterizedQuery>(t->text);
+            }
+        }
 
-        std::cout << "Reading file " << p.get() << '\n';
+        // the timetable is gone through once per iteration, or over and over
+        // until the run is over
+        size_t slots = timetable.empty() ? 0
+            : args.iterations > 0 ? timetable.size() * args.iterations
+            : SIZE_MAX;
 
-        for (auto chunk : CSV::read(p.get(), *args.csvOptions)) {
+        phases.start(RunPhases::Clock::now());
+        schedule = std::make_unique<RateSchedule>(args.rate, slots);
+        schedule->start(phases.begin(RunPhases::Phase::RAMP_UP), phases.end());
+
+        for (size_t i = 0; i < args.threads; ++i) {
             tasks.increase(1);
-            memory.increase(chunk->memorySize());
-            pool.run([chunk, &tasks, &memory] (auto) {
+            pool.run([&, i] (auto) {
                 try {
                     instantiateDB();
+                }
+                catch (const std::exception &e) {
+                    std::cerr << e.what() << "\n";
+                    tasks.decrease(1);
+                    return;
+                }
+
+                std::this_thread::sleep_until(phases.activation(i, args.threads));
+
+                std::vector<LatencyHistogram> phaseHist(RunPhases::COUNT);
+                std::vector<LatencyHistogram> streamHist(templates.size());
+                std::map<std::string, LatencyHistogram> queryHist;
+                LatencyHistogram serviceHist;
+
+                Random random(args.seed + i);
+                std::string buffer;
+
+                size_t slot;
+                RateSchedule::Clock::time_point intended;
+                while (schedule->next(slot, intended)) {
+                    size_t entry = slot % timetable.size();
+                    const auto &[stream, t] = timetable[entry];
+
+                    try {
+                        const auto &q = t->render(random, buffer);
+
+                        std::unique_ptr<ParameterizedQuery> generated;
+                        if (args.prepared && t->generated()) {
+                            generated = std::make_unique<ParameterizedQuery>(q);
+                        }
+
+                        auto qStart = RateSchedule::Clock::now();
+
+                        if (generated) db->execute(*generated);
+                        else if (args.prepared) db->execute(*parameterized[entry]);
+                        else db->query(q);
+
+                        auto qEnd = RateSchedule::Clock::now();
+
+                        uint64_t ns = std::chrono::nanoseconds(qEnd - intended).count();
+                        auto phase = phases.at(intended);
+                        phaseHist[(size_t) phase].record(ns);
+                        if (phase == RunPhases::Phase::MEASURED) {
+                            streamHist[stream].record(ns);
+                            queryHist[t->text].record(ns);
+                            serviceHist.record(std::chrono::nanoseconds(qEnd - qStart).count());
+                        }
+
+                        if (auto c = threadCounters()) c->query(ns);
+                    }
+                    catch (const std::exception &e) {
+                        std::cerr << e.what() << "\n";
+                        if (auto c = threadCounters()) c->error();
+                    }
+                }
+
+                {
+                    std::unique_lock lk(latencyMtx);
+                    for (size_t j = 0; j < phaseHist.size(); ++j) phaseLatency[j].merge(phaseHist[j]);
+                    for (size_t j = 0; j < streamHist.size(); ++j) streamLatency[j].merge(streamHist[j]);
+                    for (const auto &[q, h] : queryHist) queryLatency[q].merge(h);
+                    serviceLatency.merge(serviceHist);
+                }
+
+                tasks.decrease(1);
+            });
+        }
+
+        tasks.wait();
+    }
+    else {
+        std::cout << "Running " << templates.size() << " query streams using " << args.threads << " threads\n";
+
+        // without a duration, streams beyond the thread count wait for a
+        // thread, so connections are ramped up over the ones that start
+        // right away
+        size_t active = std::min<size_t>(templates.size(), args.threads);
 
-                    std::cout << "Loading data chunk ("
-                        << chunk->size() << " rows) into table '"
-                        << args.table << "'\n";
+        phases.start(RunPhases::Clock::now());
+
+        for (size_t streamIndex = 0; streamIndex < templates.size(); ++streamIndex) {
+            tasks.increase(1);
+            pool.run([&, streamIndex, active] (auto) {
+                std::cout << "Running query stream " << streamIndex << "\n";
 
-                    db->loadIntoTable(args.table, chunk);
+                try {
+                    instantiateDB();
                 }
                 catch (const std::exception &e) {
                     std::cerr << e.what() << "\n";
+                    tasks.decrease(1);
+                    return;
                 }
                 catch (...) {
                     std::cerr << "An unknown exception occurred while loading CSV file\n";
+                    tasks.decrease(1);
+                    return;
+                }
+
+                std::this_thread::sleep_until(phases.activation(streamIndex, active));
+
+                std::vector<LatencyHistogram> phaseHist(RunPhases::COUNT);
+                auto &hist = streamLatency[streamIndex];
+                std::map<std::string, LatencyHistogram> queries;
+
+                const auto &streamTemplates = templates[streamIndex];
+
+                // generated queries are parameterized as they run
+                std::vector<std::unique_ptr<ParameterizedQuery>> parameterized(streamTemplates.size());
+                if (args.prepared) {
+                    for (size_t k = 0; k < streamTemplates.size(); ++k) {
+                        const auto &t = streamTemplates[k];
+                        if (! t.generated()) parameterized[k] = std::make_unique<ParameterizedQuery>(t.text);
+                    }
+                }
+
+                Random random(args.seed + streamIndex);
+                std::string buffer;
+
+                // the stream loops over its queries until its iterations are
+                // done or the run is over
+                bool over = streamTemplates.empty();
+                for (size_t pass = 0; ! over && (args.iterations == 0 || pass < args.iterations); ++pass) {
+                    for (size_t k = 0; k < streamTemplates.size(); ++k) {
+                        if (RunPhases::Clock::now() >= phases.end()) {
+                            over = true;
+                            break;
+                        }
+
+                        const auto &t = streamTemplates[k];
+
+                        try {
+                            const auto &q = t.render(random, buffer);
+
+                            std::unique_ptr<ParameterizedQuery> generated;
+                            if (args.prepared && t.generated()) {
+                                generated = std::make_unique<ParameterizedQuery>(q);
+                            }
+
+                            auto qStart = RunPhases::Clock::now();
+
+                            if (generated) db->execute(*generated);
+                            else if (args.prepared) db->execute(*parameterized[k]);
+                            else db->query(q);
+
+                            auto qEnd = RunPhases::Clock::now();
+
+                            uint64_t ns = std::chrono::nanoseconds(qEnd - qStart).count();
+                            auto phase = phases.at(qStart);
+                            phaseHist[(size_t) phase].record(ns);
+                            if (phase == RunPhases::Phase::MEASURED) {
+                                hist.record(ns);
+                                queries[t.text].record(ns);
+                            }
+
+                            if (auto c = threadCounters()) c->query(ns);
+                        }
+                        catch (const std::exception &e) {
+                            std::cerr << e.what() << "\n";
+                            if (auto c = threadCounters()) c->error();
+                        }
+                        catch (...) {
+                            std::cerr << "An unknown exception occurred while loading CSV file\n";
+                            if (auto c = threadCounters()) c->error();
+                        }
+                    }
+                }
+
+                {
+                    std::unique_lock lk(latencyMtx);
+                    for (size_t j = 0; j < phaseHist.size(); ++j) phaseLatency[j].merge(phaseHist[j]);
+                    for (const auto &[q, h] : queries) queryLatency[q].merge(h);
                 }
 
-                memory.decrease(chunk->memorySize());
-                delete chunk;
                 tasks.decrease(1);
             });
         }
-
-        memory.decrease(pInfo.length());
     }
 
     tasks.wait();
-    pool.terminate();
+    auto end = RunPhases::Clock::now();
+
     closeAllConnections();
+    pool.terminate();
 
-    auto loadEnd = std::chrono::high_resolution_clock::now();
+    double queryTime = phases.seconds(RunPhases::Phase::MEASURED, end);
 
-    std::cout << "Finished data loading in " << (loadEnd - start).count() / 1e9 << "\n";
+    std::cout << "Finished " << latency.count()
+        << " queries in " << queryTime
+        << " seconds\n";
+
+    std::cout << "Latency: ";
+    latency.print(std::cout);
+    std::cout << "\n";
+
+    // queries of the earlier phases are reported on their own, and left out
+    // of everything else
+    printPhases(phases, phaseLatency, end, "queries");
+
+    if (schedule) printSchedule(*schedule, serviceLatency);
+
+    // the first line keeps the summary older scripts read, followed by the
+    // schedule of an open-loop run
+    std::stringstream stat;
+    stat << latency.count() << ',' << queryTime;
+    if (schedule) {
+        stat << ',' << schedule->rate() << ',' << schedule->late() << ',' << schedule->dropped();
+    }
+    stat << '\n';
+    LatencyHistogram::writeCSVHeader(stat);
+    latency.writeCSV(stat, "all", "");
+    writePhases(stat, phases, phaseLatency);
+    if (schedule) serviceLatency.writeCSV(stat, "service", "");
+    for (size_t i = 0; i < streamLatency.size(); ++i) {
+        streamLatency[i].writeCSV(stat, "stream", streamNames[i]);
+    }
+    for (const auto &[q, h] : queryLatency) {
+        h.writeCSV(stat, "query", q);
+    }
+    auto statStr = stat.str();
+    File statFile(args.queryStatPath);
+    statFile.open(File::READ_WRITE | File::CREATE | File::TRUNCATE);
+    statFile.write(statStr.data(), statStr.size());
 }
 
-List<std::string> * readQueries(const Path &path) {
-    auto queries = new List<std::string>();
-    
-    File f(path);
-    auto buf = new char[f.info().length() + 1];
-    f.read(buf, f.info().length());
+/**
+ * Runs a statement of a transaction, through a prepared statement with
+ * --protocol prepared.
+ */
+static void executeStatement(
+    const std::string &q,
+    const ParameterizedQuery *parameterized
+) {
+    if (! args.prepared) db->query(q);
+    else if (parameterized) db->execute(*parameterized);
+    else db->execute(ParameterizedQuery(q));
+}
 
-    std::stringstream s;
+/**
+ * Runs a transaction on the calling thread's connection. Values are drawn
+ * once, and a transaction that fails with a deadlock or lock wait timeout
+ * is rolled back and run again with the same values, up to --max-retries
+ * times. Returns false if the transaction failed for good.
+ */
+static bool runTransaction(
+    const Transaction &t,
+    const std::vector<std::unique_ptr<ParameterizedQuery>> &parameterized,
+    Random &random,
+    std::vector<std::string> &rendered,
+    std::string &buffer,
+    uint64_t &retries
+) {
+    rendered.resize(t.statements.size());
+    for (size_t k = 0; k < t.statements.size(); ++k) {
+        rendered[k] = t.statements[k].render(random, buffer);
+    }
 
-    auto p = buf;
-    while (*p != '\0') {
-        // ignore empty lines
-        while (*p == '\n') ++p;
+    for (size_t attempt = 0;; ++attempt) {
+        try {
+            db->query("BEGIN");
+            for (size_t k = 0; k < t.statements.size(); ++k) {
+                executeStatement(rendered[k], parameterized[k].get());
+            }
+            db->query("COMMIT");
 
-        // ignore lines starting with --
-        if (strncmp(p, "--", 2) == 0) {
-            while (*p != '\0' && *p != '\n') ++p;
-            continue;
+            return true;
         }
+        catch (const std::exception &e) {
+            try {
+                db->query("ROLLBACK");
+            }
+            catch (const std::exception &) {
+                // the connection is reset after a failed query, which has
+                // ended the transaction already
+            }
 
-        while (*p != '\0' && *p != '\n' && *p != ';') {
-            s << *p;
-            ++p;
-        }
-        if (*p == '\n') {
-            s << *p;
-            ++p;
-        }
-        else if (*p == ';') {
-            ++p;
-            queries->append(s.str());
-            s = std::stringstream();
+            auto error = dynamic_cast<const QueryError *>(&e);
+            if (error && error->transient() && attempt < args.maxRetries) {
+                ++retries;
+                continue;
+            }
+
+            std::cerr << t.name << ": " << e.what() << "\n";
+            return false;
         }
     }
-
-    delete[] buf;
-
-    return queries;
 }
 
-void runQueries() {
-    std::cout << "Preparing to run benchmark queries\n";
-
-    std::atomic<size_t> queryCount = 0;
+void runWorkload() {
+    std::cout << "Preparing to run workload " << args.workloadPath << "\n";
 
-    auto files = File::list(args.queryPath);
+    QueryTemplate::ChoiceFiles choiceFiles;
+    std::unique_ptr<Workload> workload;
+    try {
+        workload = std::make_unique<Workload>(args.workloadPath, choiceFiles);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        exit(1);
+    }
 
-    List<List<std::string> *> streams;
+    const auto &transactions = workload->transactions();
+
+    // parameters are taken out of the statements before the run starts,
+    // except from generated ones, whose text changes every time
+    std::vector<std::vector<std::unique_ptr<ParameterizedQuery>>> parameterized(transactions.size());
+    for (size_t i = 0; i < transactions.size(); ++i) {
+        for (const auto &t : transactions[i].statements) {
+            parameterized[i].push_back(args.prepared && ! t.generated()
+                ? std::make_unique<ParameterizedQuery>(t.text)
+                : nullptr
+            );
+        }
+    }
 
-    for (const auto &p : files) {
-        std::cout << "Reading query file " << p.get() << "\n";
+    std::cout << "Generating query values with seed " << args.seed << "\n";
 
-        auto queries = readQueries(p);
-        queryCount += queries->size();
-        streams.append(queries);
-    }
+    RunPhases phases(args.rampUp, args.warmUp, args.duration);
 
-    std::cout << "Running " << streams.size() << " query streams using " << args.threads << " threads\n";
+    // every connection records into its own histograms and counters, which
+    // are merged into these when it finishes; the per-transaction ones only
+    // hold the measured phase
+    std::mutex latencyMtx;
+    std::vector<LatencyHistogram> phaseLatency(RunPhases::COUNT);
+    auto &latency = phaseLatency[(size_t) RunPhases::Phase::MEASURED];
+    std::vector<LatencyHistogram> transactionLatency(transactions.size());
+    std::vector<uint64_t> retries(transactions.size());
+    std::vector<uint64_t> failures(transactions.size());
 
     ThreadPool pool(args.threads);
     SynchronizationCondition tasks;
 
-    auto start = std::chrono::high_resolution_clock::now();
+    std::cout << "Running " << transactions.size() << " transaction types using "
+        << args.threads << " connections\n";
 
-    size_t streamIndex = 0;
-    for (auto s : streams) {
-        tasks.increase(1);
-        pool.run([streamIndex, s, &tasks, &queryCount] (auto) {
-            std::cout << "Running query stream " << streamIndex << "\n";
+    phases.start(RunPhases::Clock::now());
 
+    for (size_t i = 0; i < args.threads; ++i) {
+        tasks.increase(1);
+        pool.run([&, i] (auto) {
             try {
                 instantiateDB();
             }
             catch (const std::exception &e) {
                 std::cerr << e.what() << "\n";
-                delete s;
-                tasks.decrease(1);
-                return;
-            }
-            catch (...) {
-                std::cerr << "An unknown exception occurred while loading CSV file\n";
-                delete s;
                 tasks.decrease(1);
                 return;
             }
 
-            for (const auto &q : *s) {
-                try {
-                    db->query(q);
+            std::this_thread::sleep_until(phases.activation(i, args.threads));
+
+            std::vector<LatencyHistogram> phaseHist(RunPhases::COUNT);
+            std::vector<LatencyHistogram> transactionHist(transactions.size());
+            std::vector<uint64_t> transactionRetries(transactions.size());
+            std::vector<uint64_t> transactionFailures(transactions.size());
+
+            Random random(args.seed + i);
+            std::vector<std::string> rendered;
+            std::string buffer;
+
+            // --iterations counts the transactions of each connection
+            for (size_t n = 0; args.iterations == 0 || n < args.iterations; ++n) {
+                auto tStart = RunPhases::Clock::now();
+                if (tStart >= phases.end()) break;
+
+                size_t k = workload->pick(random);
+                uint64_t tRetries = 0;
+                bool committed = runTransaction(
+                    transactions[k],
+                    parameterized[k],
+                    random,
+                    rendered,
+                    buffer,
+                    tRetries
+                );
+
+                auto tEnd = RunPhases::Clock::now();
+
+                // latency runs from the first attempt to the commit
+                uint64_t ns = std::chrono::nanoseconds(tEnd - tStart).count();
+                auto phase = phases.at(tStart);
+                if (committed) phaseHist[(size_t) phase].record(ns);
+                if (phase == RunPhases::Phase::MEASURED) {
+                    if (committed) transactionHist[k].record(ns);
+                    else ++transactionFailures[k];
+                    transactionRetries[k] += tRetries;
                 }
-                catch (const std::exception &e) {
-                    std::cerr << e.what() << "\n";
-                    --queryCount;
+
+                if (auto c = threadCounters()) {
+                    if (committed) c->query(ns);
+                    else c->error();
                 }
-                catch (...) {
-                    std::cerr << "An unknown exception occurred while loading CSV file\n";
-                    --queryCount;
+            }
+
+            {
+                std::unique_lock lk(latencyMtx);
+                for (size_t j = 0; j < phaseHist.size(); ++j) phaseLatency[j].merge(phaseHist[j]);
+                for (size_t j = 0; j < transactions.size(); ++j) {
+                    transactionLatency[j].merge(transactionHist[j]);
+                    retries[j] += transactionRetries[j];
+                    failures[j] += transactionFailures[j];
                 }
             }
 
-            delete s;
             tasks.decrease(1);
         });
-
-        ++streamIndex;
     }
 
     tasks.wait();
-    auto end = std::chrono::high_resolution_clock::now();
+    auto end = RunPhases::Clock::now();
 
     closeAllConnections();
     pool.terminate();
 
-    double queryTime = (end - start).count() / 1e9;
+    double seconds = phases.seconds(RunPhases::Phase::MEASURED, end);
+
+    uint64_t totalRetries = 0, totalFailures = 0;
+    for (size_t j = 0; j < transactions.size(); ++j) {
+        totalRetries += retries[j];
+        totalFailures += failures[j];
+    }
+
+    std::cout << "Finished " << latency.count() << " transactions in " << seconds
+        << " seconds (" << (seconds > 0 ? latency.count() / seconds : 0)
+        << " per second), " << totalRetries << " retried, " << totalFailures << " failed\n";
+
+    std::cout << "Latency: ";
+    latency.print(std::cout);
+    std::cout << "\n";
+
+    printPhases(phases, phaseLatency, end, "transactions");
+
+    for (size_t j = 0; j < transactions.size(); ++j) {
+        const auto &h = transactionLatency[j];
+
+        std::cout << "Transaction " << transactions[j].name << ": " << h.count()
+            << " committed (" << (seconds > 0 ? h.count() / seconds : 0) << " per second), "
+            << retries[j] << " retried, " << failures[j] << " failed, latency: ";
+        h.print(std::cout);
+        std::cout << "\n";
+    }
+
+    std::stringstream stat;
+    stat << latency.count() << ',' << seconds << ',' << totalRetries << ',' << totalFailures << '\n';
+    LatencyHistogram::writeCSVHeader(stat);
+    latency.writeCSV(stat, "all", "");
+    writePhases(stat, phases, phaseLatency);
+    for (size_t j = 0; j < transactions.size(); ++j) {
+        transactionLatency[j].writeCSV(stat, "transaction", transactions[j].name);
+    }
+    auto statStr = stat.str();
+    File statFile(args.queryStatPath);
+    statFile.open(File::READ_WRITE | File::CREATE | File::TRUNCATE);
+    statFile.write(statStr.data(), statStr.size());
+}
+
+/**
+ * How long --test-query-limit runs, one second unless --duration is given.
+ */
+static std::chrono::seconds testDuration() {
+    return std::chrono::seconds(args.duration > 0 ? args.duration : 1);
+}
+
+static void reportQueryLimit(
+    size_t queryCount,
+    double queryTime,
+    const std::vector<LatencyHistogram> &threadLatency,
+    const char *scope,
+    const RateSchedule *schedule,
+    const LatencyHistogram &serviceLatency
+) {
+    LatencyHistogram latency;
+    for (const auto &h : threadLatency) latency.merge(h);
+
+    double avgLatency = latency.mean() / 1e9;
 
     std::cout << "Finished " << queryCount
         << " queries in " << queryTime
-        << " seconds\n";
+        << " seconds (" << avgLatency << " seconds latency)\n";
+
+    std::cout << "Latency: ";
+    latency.print(std::cout);
+    std::cout << "\n";
 
+    if (schedule) printSchedule(*schedule, serviceLatency);
+
+    // the first line keeps the summary older scripts read, followed by the
+    // schedule of an open-loop run
     std::stringstream stat;
-    stat << queryCount << ',' << queryTime;
+    stat << queryCount << ',' << queryTime << ',' << avgLatency;
+    if (schedule) {
+        stat << ',' << schedule->rate() << ',' << schedule->late() << ',' << schedule->dropped();
+    }
+    stat << '\n';
+    LatencyHistogram::writeCSVHeader(stat);
+    latency.writeCSV(stat, "all", "");
+    if (schedule) serviceLatency.writeCSV(stat, "service", "");
+    for (size_t i = 0; i < threadLatency.size(); ++i) {
+        threadLatency[i].writeCSV(stat, scope, std::to_string(i));
+    }
     auto statStr = stat.str();
     File statFile(args.queryStatPath);
     statFile.open(File::READ_WRITE | File::CREATE | File::TRUNCATE);
     statFile.write(statStr.data(), statStr.size());
 }
 
+
+#ifdef HAVE_MYSQL_NONBLOCKING
+
+/**
+ * Runs the query limit test with many connections per thread, multiplexed
+ * by one AsyncMySQLDatabase in each thread.
+ */
+static void testQueryLimitAsync() {
+    std::cout << "Running query limit test using " << args.threads
+        << " threads with " << args.connectionsPerThread << " connections each\n";
+
+    ThreadPool pool(args.threads);
+    SynchronizationCondition tasks;
+
+    std::vector<std::unique_ptr<AsyncMySQLDatabase>> databases(args.threads);
+
+    for (size_t i = 0; i < args.threads; ++i) {
+        tasks.increase(1);
+        pool.run([&tasks, &adb = databases[i]] (auto) {
+            try {
+                adb = std::make_unique<AsyncMySQLDatabase>(
+                    args.host,
+                    args.user,
+                    args.password,
+                    args.database,
+                    args.port,
+                    args.connectionsPerThread
+                );
+            }
+            catch (const std::exception &e) {
+                std::cerr << e.what() << "\n";
+            }
+            tasks.decrease(1);
+        });
+    }
+    tasks.wait();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto timeup = start + testDuration();
+    std::atomic<size_t> queryCount = 0;
+    std::vector<LatencyHistogram> threadLatency(args.threads);
+
+    for (size_t i = 0; i < args.threads; ++i) {
+        if (! databases[i]) continue;
+
+        tasks.increase(1);
+        pool.run([&tasks, timeup, &queryCount, &adb = *databases[i], &hist = threadLatency[i]] (auto) {
+            auto c = threadCounters();
+            size_t count = 0;
+
+            adb.run(
+                [timeup] (size_t) -> const char * {
+                    if (std::chrono::high_resolution_clock::now() >= timeup) return nullptr;
+                    return "SELECT @@autocommit";
+                },
+                [&] (size_t, uint64_t ns, const char *error) {
+                    if (error != nullptr) {
+                        std::cerr << error << "\n";
+                        if (c) c->error();
+                        return;
+                    }
+
+                    hist.record(ns);
+                    ++count;
+                    if (c) c->query(ns);
+                }
+            );
+
+            queryCount += count;
+            tasks.decrease(1);
+        });
+    }
+    tasks.wait();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    databases.clear();
+    pool.terminate();
+
+    reportQueryLimit(
+        queryCount,
+        (end - start).count() / 1e9,
+        threadLatency,
+        "thread",
+        nullptr,
+        LatencyHistogram()
+    );
+}
+
+#endif
+
 void testQueryLimit() {
+#ifdef HAVE_MYSQL_NONBLOCKING
+    if (args.connectionsPerThread > 1) {
+        testQueryLimitAsync();
+        return;
+    }
+#endif
+
     std::cout << "Running query limit test using " << args.threads << " threads\n";
 
     ThreadPool pool(args.threads);
@@ -488,41 +2504,79 @@ void testQueryLimit() {
     tasks.wait();
 
     auto start = std::chrono::high_resolution_clock::now();
-    auto timeup = start + std::chrono::seconds(args.duration);
+    auto timeup = start + testDuration();
     std::atomic<size_t> queryCount = 0;
-    std::atomic<size_t> latency = 0;
+    std::vector<LatencyHistogram> threadLatency(args.threads);
+    std::vector<LatencyHistogram> threadService(args.threads);
+
+    std::unique_ptr<RateSchedule> schedule;
+    if (args.rate > 0) {
+        auto now = RateSchedule::Clock::now();
+        schedule = std::make_unique<RateSchedule>(args.rate);
+        schedule->start(now, now + testDuration());
+    }
+
     for (size_t i = 0; i < args.threads; ++i) {
         tasks.increase(1);
-        pool.run([&tasks, &start, timeup, &queryCount, &latency] (auto) {
+        pool.run([&tasks, &start, timeup, &queryCount, &schedule, &hist = threadLatency[i], &service = threadService[i]] (auto) {
             std::chrono::high_resolution_clock::time_point qStart, qEnd;
 
+            ParameterizedQuery probe("SELECT @@autocommit");
+
             size_t count = 0;
-            std::chrono::high_resolution_clock::duration latencySum;
 
             try {
-                do {
+                // the pool does not promise that every thread ran one of the
+                // connect tasks above
+                instantiateDB();
+
+                auto c = threadCounters();
+
+                size_t slot;
+                RateSchedule::Clock::time_point intended;
+                while (schedule && schedule->next(slot, intended)) {
+                    auto sent = RateSchedule::Clock::now();
+
+                    if (args.prepared) db->execute(probe);
+                    else db->query(probe.text);
+
+                    auto done = RateSchedule::Clock::now();
+
+                    uint64_t ns = std::chrono::nanoseconds(done - intended).count();
+                    hist.record(ns);
+                    service.record(std::chrono::nanoseconds(done - sent).count());
+                    ++count;
+
+                    if (c) c->query(ns);
+                }
+
+                if (! schedule) do {
                     qStart = std::chrono::high_resolution_clock::now();
 
-                    db->query("SELECT @@autocommit");
+                    if (args.prepared) db->execute(probe);
+                    else db->query(probe.text);
 
                     qEnd = std::chrono::high_resolution_clock::now();
 
-                    latencySum += qEnd - qStart;
+                    hist.record((qEnd - qStart).count());
                     ++count;
+
+                    if (c) c->query((qEnd - qStart).count());
                 } while (qEnd < timeup);
             }
             catch (const std::exception &e) {
                 std::cerr << e.what() << "\n";
+                if (auto c = threadCounters()) c->error();
                 tasks.decrease(1);
                 return;
             }
             catch (...) {
                 std::cerr << "An unknown exception occurred\n";
+                if (auto c = threadCounters()) c->error();
                 tasks.decrease(1);
                 return;
             }
 
-            latency += latencySum.count();
             queryCount += count;
 
             tasks.decrease(1);
@@ -534,28 +2588,68 @@ void testQueryLimit() {
     closeAllConnections();
     pool.terminate();
 
-    double queryTime = (end - start).count() / 1e9;
-    double avgLatency = latency / queryCount / 1e9;
-
-    std::cout << "Finished " << queryCount
-        << " queries in " << queryTime
-        << " seconds (" << avgLatency << " seconds latency)\n";
-
-    std::stringstream stat;
-    stat << queryCount << ',' << queryTime << ',' << avgLatency;
-    auto statStr = stat.str();
-    File statFile(args.queryStatPath);
-    statFile.open(File::READ_WRITE | File::CREATE | File::TRUNCATE);
-    statFile.write(statStr.data(), statStr.size());
+    LatencyHistogram serviceLatency;
+    for (const auto &h : threadService) serviceLatency.merge(h);
+
+    reportQueryLimit(
+        queryCount,
+        (end - start).count() / 1e9,
+        threadLatency,
+        "connection",
+        schedule.get(),
+        serviceLatency
+    );
 }
 
 int main(int argc, char **argv) {
 
     if (! parseArguments(argc - 1, argv + 1)) exit(1);
 
-    if (args.loadCsv) loadCsvData();
+    if (args.reportInterval > 0 || args.reportPath != nullptr) {
+        try {
+            reporter = new IntervalReporter(
+                args.reportInterval > 0 ? args.reportInterval : 1,
+                args.reportPath,
+                args.reportFormat
+            );
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            exit(1);
+        }
+
+        reporter->start();
+    }
+
+    try {
+        checkLoadKeys();
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        exit(1);
+    }
+
+    auto deferral = deferIndexes();
+
+    // indexes that were dropped are built again however the load ends
+    bool loaded = true;
+    try {
+        if (args.loadCsv) loadCsvData();
+        if (args.generate) generateData();
+        if (args.loadBin) loadBinData();
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        loaded = false;
+    }
+
+    if (deferral) restoreIndexes(*deferral);
+    if (! loaded) exit(1);
     if (args.runQueries) runQueries();
+    if (args.workloadPath != nullptr) runWorkload();
     if (args.testQueryLimit) testQueryLimit();
 
+    if (reporter != nullptr) reporter->stop();
+
     exit(0);
 }
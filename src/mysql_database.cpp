@@ -1,28 +1,53 @@
 #include <mysql_database.h>
+#include <mysqld_error.h>
 #include <sstream>
+#include <string.h>
+#include <algorithm>
+#include <charconv>
 
 MySQLDatabase::MySQLDatabase(
     const char *host,
     const char *user,
     const char *password,
     const char *db,
-    unsigned int port
+    unsigned int port,
+    bool localInfile
 ):  MySQLDatabase()
 {
+    if (localInfile) {
+        unsigned int enable = 1;
+        mysql_options(_conn(), MYSQL_OPT_LOCAL_INFILE, &enable);
+    }
+
     if (! mysql_real_connect(_conn(), host, user, password, db, port, NULL, 0)) {
         throw DynamicMessageError(mysql_error(_conn()));
     }
 }
 
 MySQLDatabase::~MySQLDatabase() {
+    _clearStatements();
     mysql_close(_conn());
 }
 
+// errors after which the server has rolled back the statement or the whole
+// transaction, and running it again may succeed
+static bool transient(unsigned int code) {
+    return code == ER_LOCK_DEADLOCK || code == ER_LOCK_WAIT_TIMEOUT;
+}
+
+void MySQLDatabase::_queryFailed() const {
+    auto e = QueryError(mysql_error(_conn()), transient(mysql_errno(_conn())));
+
+    // statements are closed while the server still knows them, since the
+    // reset drops them on its side
+    _clearStatements();
+    mysql_reset_connection(_conn());
+    throw e;
+}
+
 void MySQLDatabase::query(const std::string &sql) const {
     if (mysql_query(_conn(), sql.c_str())) {
-        auto e = DynamicMessageError(mysql_error(_conn()));
-        mysql_reset_connection(_conn());
-        throw e;
+        _queryFailed();
     }
     else {
         auto result = mysql_store_result(_conn());
@@ -30,126 +55,516 @@ void MySQLDatabase::query(const std::string &sql) const {
             mysql_free_result(result);
         }
         else if (mysql_field_count(_conn()) != 0) {
-            auto e = DynamicMessageError(mysql_error(_conn()));
-            mysql_reset_connection(_conn());
-            throw e;
+            _queryFailed();
         }
     }
 }
 
-void MySQLDatabase::loadIntoTable(
-    const std::string &table,
-    const ColumnarTableChunk *chunk
-) const {
+std::vector<std::vector<std::string>> MySQLDatabase::fetch(const std::string &sql) const {
+    if (mysql_query(_conn(), sql.c_str())) _queryFailed();
+
+    std::vector<std::vector<std::string>> rows;
+
+    auto result = mysql_store_result(_conn());
+    if (result == nullptr) {
+        if (mysql_field_count(_conn()) != 0) _queryFailed();
+        return rows;
+    }
 
-    mysql_query(_conn(), "SET autocommit=0");
-    mysql_query(_conn(), "SET unique_checks=0");
-    mysql_query(_conn(), "SET foreign_key_checks=0");
+    unsigned int numFields = mysql_num_fields(result);
+    while (auto row = mysql_fetch_row(result)) {
+        auto lengths = mysql_fetch_lengths(result);
 
+        rows.emplace_back();
+        for (unsigned int i = 0; i < numFields; ++i) {
+            rows.back().emplace_back(row[i] ? std::string(row[i], lengths[i]) : std::string());
+        }
+    }
+
+    mysql_free_result(result);
+    return rows;
+}
+
+// the server caps prepared statements across all connections
+// (max_prepared_stmt_count), so each connection keeps a bounded number
+#define MAX_STATEMENTS ((size_t) 256)
+
+MYSQL_STMT * MySQLDatabase::_statement(const std::string &sql) const {
+    auto it = _statements.find(sql);
+    if (it != _statements.end()) return it->second;
+
+    MYSQL_STMT *stmt = _prepare(sql);
+    _cacheStatement(sql, stmt);
+    return stmt;
+}
+
+MYSQL_STMT * MySQLDatabase::_prepare(const std::string &sql) const {
     MYSQL_STMT *stmt = mysql_stmt_init(_conn());
     if (! stmt) {
         throw RuntimeError("Insufficient memory");
     }
 
-    std::stringstream sql;
-    sql << "INSERT INTO " << table << " VALUES (?";
-    for (size_t i = 0; i < chunk->numColumns() - 1; ++i) sql << ",?";
-    sql << ')';
-
-    if (mysql_stmt_prepare(stmt, sql.str().c_str(), -1)) {
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size())) {
         auto e = DynamicMessageError(mysql_stmt_error(stmt));
         mysql_stmt_close(stmt);
         throw e;
     }
 
-    MYSQL_BIND *bind = new MYSQL_BIND[chunk->numColumns()];
-    memset(bind, 0, chunk->numColumns() * sizeof(MYSQL_BIND));
-    std::vector<size_t> inc(chunk->numColumns());
+    return stmt;
+}
 
-    for (size_t i = 0; i < chunk->numColumns(); ++i) {
-        switch (chunk->columns[i].type) {
-        case DataType::UINT8:
-        case DataType::INT8:
-            bind[i].buffer = chunk->columns[i].data;
-            bind[i].buffer_type = MYSQL_TYPE_TINY;
-            inc[i] = 1;
-            break;
+void MySQLDatabase::_cacheStatement(const std::string &sql, MYSQL_STMT *stmt) const {
+    if (_statements.size() == MAX_STATEMENTS) _clearStatements();
+    _statements[sql] = stmt;
+}
 
-        case DataType::UINT16:
-        case DataType::INT16:
-            bind[i].buffer = chunk->columns[i].data;
-            bind[i].buffer_type = MYSQL_TYPE_SHORT;
-            inc[i] = 2;
-            break;
+void MySQLDatabase::_evictStatement(const std::string &sql) const {
+    auto it = _statements.find(sql);
+    if (it == _statements.end()) return;
 
-        case DataType::UINT32:
-        case DataType::INT32:
-            bind[i].buffer = chunk->columns[i].data;
-            bind[i].buffer_type = MYSQL_TYPE_LONG;
-            inc[i] = 4;
-            break;
+    if (it->second) mysql_stmt_close(it->second);
+    _statements.erase(it);
+}
+
+void MySQLDatabase::_clearStatements() const {
+    for (const auto &[sql, stmt] : _statements) {
+        if (stmt) mysql_stmt_close(stmt);
+    }
+    _statements.clear();
+}
 
-        case DataType::UINT64:
-        case DataType::INT64:
-            bind[i].buffer = chunk->columns[i].data;
+void MySQLDatabase::execute(const ParameterizedQuery &query) const {
+    MYSQL_STMT *stmt;
+    try {
+        stmt = _statement(query.sql);
+    }
+    catch (const std::exception &) {
+        stmt = nullptr;
+        _cacheStatement(query.sql, nullptr);
+    }
+
+    size_t numParams = query.parameters.size();
+    if (stmt == nullptr || mysql_stmt_param_count(stmt) != numParams) {
+        this->query(query.text);
+        return;
+    }
+
+    std::vector<MYSQL_BIND> bind(numParams);
+    memset(bind.data(), 0, bind.size() * sizeof(MYSQL_BIND));
+
+    for (size_t i = 0; i < numParams; ++i) {
+        auto &param = query.parameters[i];
+
+        switch (param.type) {
+        case QueryParameter::Type::INTEGER:
+            bind[i].buffer = (void *) &param.integer;
             bind[i].buffer_type = MYSQL_TYPE_LONGLONG;
-            inc[i] = 8;
             break;
 
-        case DataType::FLOAT32:
-            bind[i].buffer = chunk->columns[i].data;
-            bind[i].buffer_type = MYSQL_TYPE_FLOAT;
-            inc[i] = 4;
+        case QueryParameter::Type::DOUBLE:
+            bind[i].buffer = (void *) &param.real;
+            bind[i].buffer_type = MYSQL_TYPE_DOUBLE;
             break;
 
-        case DataType::FLOAT64:
-            bind[i].buffer = chunk->columns[i].data;
-            bind[i].buffer_type = MYSQL_TYPE_DOUBLE;
-            inc[i] = 8;
+        case QueryParameter::Type::DECIMAL:
+            bind[i].buffer = (void *) param.text.data();
+            bind[i].buffer_type = MYSQL_TYPE_NEWDECIMAL;
+            bind[i].buffer_length = param.text.size();
             break;
 
-        case DataType::STRING:
-            bind[i].buffer = chunk->columns[i].data;
+        case QueryParameter::Type::STRING:
+            bind[i].buffer = (void *) param.text.data();
             bind[i].buffer_type = MYSQL_TYPE_STRING;
-            inc[i] += sizeof(char *);
+            bind[i].buffer_length = param.text.size();
             break;
+        }
+    }
 
-        case DataType::MYSQL_DATE:
-            bind[i].buffer = chunk->columns[i].data;
-            bind[i].buffer_type = MYSQL_TYPE_DATE;
-            inc[i] += sizeof(MYSQL_TIME);
-            break;
+    bool failed = (numParams != 0 && mysql_stmt_bind_param(stmt, bind.data()))
+        || mysql_stmt_execute(stmt);
+
+    // results are read and dropped, as they are for text queries
+    if (! failed && mysql_stmt_field_count(stmt) != 0) {
+        failed = mysql_stmt_store_result(stmt);
+        mysql_stmt_free_result(stmt);
+    }
+
+    if (failed) {
+        auto e = QueryError(mysql_stmt_error(stmt), transient(mysql_stmt_errno(stmt)));
+        _clearStatements();
+        mysql_reset_connection(_conn());
+        throw e;
+    }
+}
+
+// the MySQL protocol limits a prepared statement to 65535 placeholders
+#define MAX_PLACEHOLDERS ((size_t) 65535)
+
+static std::string insertStatement(
+    const std::string &table,
+    size_t numColumns,
+    size_t numRows
+) {
+    std::stringstream sql;
+    sql << "INSERT INTO " << table << " VALUES ";
+    for (size_t r = 0; r < numRows; ++r) {
+        if (r != 0) sql << ',';
+        sql << "(?";
+        for (size_t i = 0; i < numColumns - 1; ++i) sql << ",?";
+        sql << ')';
+    }
+    return sql.str();
+}
+
+static void bindValue(MYSQL_BIND &bind, const ColumnChunk &column, size_t row) {
+    switch (column.type) {
+    case DataType::UINT8:
+    case DataType::INT8:
+        bind.buffer = static_cast<char *>(column.data) + row;
+        bind.buffer_type = MYSQL_TYPE_TINY;
+        bind.is_unsigned = column.type == DataType::UINT8;
+        break;
+
+    case DataType::UINT16:
+    case DataType::INT16:
+        bind.buffer = static_cast<char *>(column.data) + row * 2;
+        bind.buffer_type = MYSQL_TYPE_SHORT;
+        bind.is_unsigned = column.type == DataType::UINT16;
+        break;
+
+    case DataType::UINT32:
+    case DataType::INT32:
+        bind.buffer = static_cast<char *>(column.data) + row * 4;
+        bind.buffer_type = MYSQL_TYPE_LONG;
+        bind.is_unsigned = column.type == DataType::UINT32;
+        break;
+
+    case DataType::UINT64:
+    case DataType::INT64:
+        bind.buffer = static_cast<char *>(column.data) + row * 8;
+        bind.buffer_type = MYSQL_TYPE_LONGLONG;
+        bind.is_unsigned = column.type == DataType::UINT64;
+        break;
+
+    case DataType::FLOAT32:
+        bind.buffer = static_cast<char *>(column.data) + row * 4;
+        bind.buffer_type = MYSQL_TYPE_FLOAT;
+        break;
+
+    case DataType::FLOAT64:
+        bind.buffer = static_cast<char *>(column.data) + row * 8;
+        bind.buffer_type = MYSQL_TYPE_DOUBLE;
+        break;
+
+    case DataType::STRING:
+        bind.buffer = (char *) column.stringAt(row);
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer_length = column.stringLength(row);
+        break;
+
+    case DataType::MYSQL_DATE:
+        bind.buffer = static_cast<MYSQL_TIME *>(column.data) + row;
+        bind.buffer_type = MYSQL_TYPE_DATE;
+        break;
+
+    case DataType::MYSQL_DATETIME:
+        bind.buffer = static_cast<MYSQL_TIME *>(column.data) + row;
+        bind.buffer_type = MYSQL_TYPE_DATETIME;
+        break;
+    }
+}
+
+static bool executeBatch(
+    MYSQL_STMT *stmt,
+    MYSQL_BIND *bind,
+    const ColumnarTableChunk *chunk,
+    size_t firstRow,
+    size_t numRows
+) {
+    size_t numColumns = chunk->numColumns();
+    for (size_t r = 0; r < numRows; ++r) {
+        for (size_t j = 0; j < numColumns; ++j) {
+            bindValue(bind[r * numColumns + j], chunk->columns[j], firstRow + r);
         }
     }
 
+    return ! mysql_stmt_bind_param(stmt, bind) && ! mysql_stmt_execute(stmt);
+}
+
+void MySQLDatabase::_insertRows(
+    const std::string &table,
+    const ColumnarTableChunk *chunk,
+    size_t batchRows
+) const {
     size_t chunkSize = chunk->size();
     size_t numColumns = chunk->numColumns();
-    for (size_t i = 0; i < chunkSize; ++i) {
-        mysql_stmt_bind_param(stmt, bind);
+    batchRows = std::min(batchRows, MAX_PLACEHOLDERS / numColumns);
+    if (batchRows == 0) batchRows = 1;
 
-        if (mysql_stmt_execute(stmt)) {
-            auto e = DynamicMessageError(mysql_stmt_error(stmt));
+    std::vector<MYSQL_BIND> bind(batchRows * numColumns);
+    memset(bind.data(), 0, bind.size() * sizeof(MYSQL_BIND));
 
-            delete[] bind;
+    // full batches share one statement, which stays prepared for the next
+    // chunk; the remainder is sent through a second statement sized to the
+    // tail of the chunk, which is closed again since tails vary from chunk
+    // to chunk and would fill the server's max_prepared_stmt_count
+    size_t row = 0;
+    if (chunkSize >= batchRows) {
+        auto sql = insertStatement(table, numColumns, batchRows);
+        MYSQL_STMT *stmt = _statement(sql);
 
-            mysql_stmt_close(stmt);
+        for (; row + batchRows <= chunkSize; row += batchRows) {
+            if (! executeBatch(stmt, bind.data(), chunk, row, batchRows)) {
+                auto e = DynamicMessageError(mysql_stmt_error(stmt));
+                _evictStatement(sql);
+                throw e;
+            }
+        }
+    }
 
+    if (row < chunkSize) {
+        size_t tailRows = chunkSize - row;
+        MYSQL_STMT *stmt = _prepare(insertStatement(table, numColumns, tailRows));
+
+        if (! executeBatch(stmt, bind.data(), chunk, row, tailRows)) {
+            auto e = DynamicMessageError(mysql_stmt_error(stmt));
+            mysql_stmt_close(stmt);
             throw e;
         }
+        mysql_stmt_close(stmt);
+    }
+}
 
-        for (size_t j = 0; j < numColumns; ++j) {
-            *((char **) (&bind[j].buffer)) += inc[j];
+/**
+ * Serializes a chunk row by row into the tab-separated text expected by
+ * LOAD DATA, as the client library asks for more input.
+ */
+class InfileStream {
+
+private:
+
+    const ColumnarTableChunk *_chunk;
+    size_t _row = 0;
+
+    std::string _line;
+    size_t _linePos = 0;
+
+    template <class T>
+    void _appendNumber(T value) {
+        char buf[32];
+        auto r = std::to_chars(buf, buf + sizeof(buf), value);
+        _line.append(buf, r.ptr - buf);
+    }
+
+    void _appendString(const char *str, size_t len) {
+        for (const char *end = str + len; str != end; ++str) {
+            switch (*str) {
+            case '\\': _line.append("\\\\", 2); break;
+            case '\t': _line.append("\\t", 2); break;
+            case '\n': _line.append("\\n", 2); break;
+            case '\r': _line.append("\\r", 2); break;
+            case '\0': _line.append("\\0", 2); break;
+            default: _line.push_back(*str);
+            }
         }
     }
 
-    delete[] bind;
+    void _appendDate(const MYSQL_TIME &t) {
+        char buf[16];
+        int n = snprintf(buf, sizeof(buf), "%04u-%02u-%02u", t.year, t.month, t.day);
+        _line.append(buf, n);
+    }
+
+    void _appendDateTime(const MYSQL_TIME &t) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "%04u-%02u-%02u %02u:%02u:%02u.%06lu",
+            t.year, t.month, t.day, t.hour, t.minute, t.second, t.second_part);
+        _line.append(buf, n);
+    }
+
+    void _serializeRow() {
+        _line.clear();
+        _linePos = 0;
+
+        for (size_t j = 0; j < _chunk->numColumns(); ++j) {
+            if (j != 0) _line.push_back('\t');
+
+            const auto &c = _chunk->columns[j];
+            switch (c.type) {
+            case DataType::UINT8:
+                _appendNumber(static_cast<const uint8_t *>(c.data)[_row]);
+                break;
+
+            case DataType::UINT16:
+                _appendNumber(static_cast<const uint16_t *>(c.data)[_row]);
+                break;
+
+            case DataType::UINT32:
+                _appendNumber(static_cast<const uint32_t *>(c.data)[_row]);
+                break;
+
+            case DataType::UINT64:
+                _appendNumber(static_cast<const uint64_t *>(c.data)[_row]);
+                break;
+
+            case DataType::INT8:
+                _appendNumber(static_cast<const int8_t *>(c.data)[_row]);
+                break;
+
+            case DataType::INT16:
+                _appendNumber(static_cast<const int16_t *>(c.data)[_row]);
+                break;
+
+            case DataType::INT32:
+                _appendNumber(static_cast<const int32_t *>(c.data)[_row]);
+                break;
+
+            case DataType::INT64:
+                _appendNumber(static_cast<const int64_t *>(c.data)[_row]);
+                break;
+
+            case DataType::FLOAT32:
+                _appendNumber(static_cast<const float *>(c.data)[_row]);
+                break;
+
+            case DataType::FLOAT64:
+                _appendNumber(static_cast<const double *>(c.data)[_row]);
+                break;
+
+            case DataType::STRING:
+                _appendString(c.stringAt(_row), c.stringLength(_row));
+                break;
+
+            case DataType::MYSQL_DATE:
+                _appendDate(static_cast<const MYSQL_TIME *>(c.data)[_row]);
+                break;
+
+            case DataType::MYSQL_DATETIME:
+                _appendDateTime(static_cast<const MYSQL_TIME *>(c.data)[_row]);
+                break;
+            }
+        }
+
+        _line.push_back('\n');
+        ++_row;
+    }
+
+public:
+
+    InfileStream(const ColumnarTableChunk *chunk)
+    :   _chunk(chunk)
+    { }
+
+    int fill(char *buf, unsigned int len) {
+        unsigned int n = 0;
+
+        while (n < len) {
+            if (_linePos == _line.size()) {
+                if (_row == _chunk->size()) break;
+                _serializeRow();
+            }
 
-    mysql_stmt_close(stmt);
+            size_t count = std::min<size_t>(len - n, _line.size() - _linePos);
+            memcpy(buf + n, _line.data() + _linePos, count);
+            _linePos += count;
+            n += count;
+        }
+
+        return n;
+    }
+
+    static int init(void **ptr, const char *, void *userdata) {
+        *ptr = userdata;
+        return 0;
+    }
+
+    static int read(void *ptr, char *buf, unsigned int len) {
+        return static_cast<InfileStream *>(ptr)->fill(buf, len);
+    }
+
+    static void end(void *) { }
+
+    static int error(void *, char *msg, unsigned int len) {
+        snprintf(msg, len, "Error streaming data chunk");
+        return 2000;
+    }
+};
+
+void MySQLDatabase::_loadInfile(
+    const std::string &table,
+    const ColumnarTableChunk *chunk
+) const {
+    InfileStream stream(chunk);
+
+    mysql_set_local_infile_handler(
+        _conn(),
+        InfileStream::init,
+        InfileStream::read,
+        InfileStream::end,
+        InfileStream::error,
+        &stream
+    );
+
+    // the file name is never opened, the handler above serves the data
+    std::stringstream sql;
+    sql << "LOAD DATA LOCAL INFILE 'chunk' INTO TABLE " << table
+        << " FIELDS TERMINATED BY '\\t' ESCAPED BY '\\\\'"
+        << " LINES TERMINATED BY '\\n'";
+
+    auto failed = mysql_query(_conn(), sql.str().c_str());
+    mysql_set_local_infile_default(_conn());
+
+    if (failed) {
+        throw DynamicMessageError(mysql_error(_conn()));
+    }
+}
+
+void MySQLDatabase::loadIntoTable(
+    const std::string &table,
+    const ColumnarTableChunk *chunk,
+    const LoadOptions &options
+) const {
+
+    // a chunk is loaded as one transaction without unique and foreign key
+    // checks, and the session is then put back the way it was found
+    if (_restoreSession.empty()) {
+        auto rows = fetch("SELECT @@autocommit, @@unique_checks, @@foreign_key_checks");
+        bool known = rows.size() == 1 && rows[0].size() == 3;
+
+        std::stringstream sql;
+        sql << "SET autocommit=" << (known ? rows[0][0] : "1")
+            << ", unique_checks=" << (known ? rows[0][1] : "1")
+            << ", foreign_key_checks=" << (known ? rows[0][2] : "1");
+        _restoreSession = sql.str();
+    }
+
+    query("SET autocommit=0, unique_checks=0, foreign_key_checks=0");
+
+    try {
+        switch (options.method) {
+        case LoadMethod::STMT:
+            _insertRows(table, chunk, 1);
+            break;
+
+        case LoadMethod::MULTIROW:
+            _insertRows(table, chunk, options.batchRows);
+            break;
+
+        case LoadMethod::INFILE:
+            _loadInfile(table, chunk);
+            break;
+        }
+
+        query("COMMIT");
+    }
+    catch (...) {
+        // the rows of a failed chunk must not be committed with the next
+        mysql_query(_conn(), "ROLLBACK");
+        mysql_query(_conn(), _restoreSession.c_str());
+        throw;
+    }
 
-    mysql_query(_conn(), "SET foreign_key_checks=0");
-    mysql_query(_conn(), "SET unique_checks=0");
-    mysql_query(_conn(), "SET autocommit=0");
-    mysql_query(_conn(), "COMMIT");
+    query(_restoreSession);
 }
 
 MySQLDatabase::__Init MySQLDatabase::__init;
@@ -0,0 +1,273 @@
+#include <parameterized_query.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool isWordChar(char c) {
+    return isalnum((unsigned char) c) || c == '_' || c == '$';
+}
+
+// words that end an ORDER BY or GROUP BY list
+static const char *LIST_END[] = {
+    "LIMIT", "HAVING", "WINDOW", "UNION", "EXCEPT", "INTERSECT",
+    "FROM", "WHERE", "FOR", "INTO", "LOCK",
+};
+
+// types whose length and precision are written in parentheses
+static const char *SIZED_TYPES[] = {
+    "CHAR", "VARCHAR", "BINARY", "VARBINARY", "DECIMAL", "NUMERIC",
+    "FLOAT", "DOUBLE", "DATETIME", "TIME", "TIMESTAMP",
+};
+
+/**
+ * Returns the end of the quoted text starting at p, past the closing quote.
+ */
+static const char * skipQuoted(const char *p, const char *end) {
+    char quote = *p++;
+
+    while (p < end) {
+        if (*p == '\\' && quote != '`') {
+            p += 2;
+        }
+        else if (*p == quote) {
+            // a doubled quote stands for the quote itself
+            if (p + 1 < end && p[1] == quote) p += 2;
+            else return p + 1;
+        }
+        else {
+            ++p;
+        }
+    }
+
+    return end;
+}
+
+static std::string unescape(const char *begin, const char *end) {
+    std::string s;
+
+    // skip the quotes
+    for (const char *p = begin + 1; p < end - 1; ++p) {
+        if (*p == '\\' && p + 1 < end - 1) {
+            switch (*++p) {
+            case '0': s.push_back('\0'); break;
+            case 'b': s.push_back('\b'); break;
+            case 'n': s.push_back('\n'); break;
+            case 'r': s.push_back('\r'); break;
+            case 't': s.push_back('\t'); break;
+            case 'Z': s.push_back('\032'); break;
+
+            // kept as is for LIKE patterns
+            case '%':
+            case '_':
+                s.push_back('\\');
+                s.push_back(*p);
+                break;
+
+            default: s.push_back(*p);
+            }
+        }
+        else if (*p == '\'' && p + 1 < end - 1 && p[1] == '\'') {
+            s.push_back('\'');
+            ++p;
+        }
+        else {
+            s.push_back(*p);
+        }
+    }
+
+    return s;
+}
+
+ParameterizedQuery::ParameterizedQuery(const std::string &text)
+:   text(text)
+{
+    const char *begin = text.c_str();
+    const char *end = begin + text.size();
+    const char *p = begin;
+
+    // the last word, upper-cased, and whether it was the last token
+    std::string word;
+    bool afterWord = false;
+    char prev = '\0';
+
+    // whether numbers right after BY or a comma are column positions
+    bool byList = false;
+    int depth = 0, byDepth = 0;
+
+    // depth of the parentheses of a type such as DECIMAL(10,2), or -1
+    int typeDepth = -1;
+
+    while (p < end) {
+        char c = *p;
+        const char *q = p + 1;
+
+        if ((c == '-' && q < end && *q == '-' && (q + 1 == end || isspace((unsigned char) q[1])))
+            || c == '#'
+        ) {
+            while (q < end && *q != '\n') ++q;
+            sql.append(p, q);
+            p = q;
+            continue;
+        }
+
+        if (c == '/' && q < end && *q == '*') {
+            auto close = strstr(q + 1, "*/");
+            q = close == nullptr ? end : close + 2;
+            sql.append(p, q);
+            p = q;
+            continue;
+        }
+
+        if (isspace((unsigned char) c)) {
+            sql.push_back(c);
+            ++p;
+            continue;
+        }
+
+        if (c == '"' || c == '`') {
+            q = skipQuoted(p, end);
+            sql.append(p, q);
+            p = q;
+            afterWord = false;
+            prev = c;
+            continue;
+        }
+
+        if (c == '\'') {
+            q = skipQuoted(p, end);
+
+            bool typed = afterWord && (word == "DATE" || word == "TIME" || word == "TIMESTAMP");
+            bool prefixed = p != begin && isWordChar(p[-1]);
+
+            if (typed || prefixed) {
+                sql.append(p, q);
+            }
+            else {
+                QueryParameter param;
+                param.type = QueryParameter::Type::STRING;
+                param.text = unescape(p, q);
+                parameters.push_back(std::move(param));
+                sql.push_back('?');
+            }
+
+            p = q;
+            afterWord = false;
+            prev = c;
+            continue;
+        }
+
+        if (isdigit((unsigned char) c) || (c == '.' && q < end && isdigit((unsigned char) *q))) {
+            // hexadecimal and binary literals keep their prefix
+            bool radix = c == '0' && q < end && strchr("xXbB", *q) != nullptr;
+
+            q = p;
+            while (q < end && isdigit((unsigned char) *q)) ++q;
+
+            bool dot = q < end && *q == '.';
+            if (dot) {
+                ++q;
+                while (q < end && isdigit((unsigned char) *q)) ++q;
+            }
+
+            bool exponent = false;
+            if (q < end && (*q == 'e' || *q == 'E')) {
+                const char *e = q + 1;
+                if (e < end && (*e == '+' || *e == '-')) ++e;
+                if (e < end && isdigit((unsigned char) *e)) {
+                    exponent = true;
+                    q = e;
+                    while (q < end && isdigit((unsigned char) *q)) ++q;
+                }
+            }
+
+            // a word that starts with digits
+            if (radix || (q < end && isWordChar(*q))) {
+                while (q < end && isWordChar(*q)) ++q;
+                sql.append(p, q);
+                p = q;
+                afterWord = false;
+                prev = c;
+                continue;
+            }
+
+            bool position = byList && depth == byDepth
+                && ((afterWord && word == "BY") || prev == ',');
+
+            if (position || depth == typeDepth) {
+                sql.append(p, q);
+            }
+            else {
+                QueryParameter param;
+                std::string number(p, q);
+
+                if (exponent) {
+                    param.type = QueryParameter::Type::DOUBLE;
+                    param.real = strtod(number.c_str(), nullptr);
+                }
+                else {
+                    errno = 0;
+                    param.integer = strtoll(number.c_str(), nullptr, 10);
+                    param.type = dot || errno == ERANGE
+                        ? QueryParameter::Type::DECIMAL
+                        : QueryParameter::Type::INTEGER;
+                    param.text = number;
+                }
+
+                parameters.push_back(std::move(param));
+                sql.push_back('?');
+            }
+
+            p = q;
+            afterWord = false;
+            prev = '0';
+            continue;
+        }
+
+        if (isWordChar(c)) {
+            while (q < end && isWordChar(*q)) ++q;
+            sql.append(p, q);
+
+            word.assign(p, q);
+            for (auto &ch : word) ch = toupper((unsigned char) ch);
+
+            if (word == "BY") {
+                byList = true;
+                byDepth = depth;
+            }
+            else {
+                for (auto w : LIST_END) {
+                    if (word == w) byList = false;
+                }
+            }
+
+            p = q;
+            afterWord = true;
+            prev = c;
+            continue;
+        }
+
+        if (c == '(') {
+            ++depth;
+
+            if (afterWord) {
+                for (auto t : SIZED_TYPES) {
+                    if (word == t) typeDepth = depth;
+                }
+            }
+        }
+        else if (c == ')') {
+            if (depth == typeDepth) typeDepth = -1;
+            --depth;
+            if (depth < byDepth) byList = false;
+        }
+        else if (c == ';') {
+            byList = false;
+        }
+
+        sql.push_back(c);
+        ++p;
+        afterWord = false;
+        prev = c;
+    }
+}
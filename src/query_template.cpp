@@ -0,0 +1,176 @@
+#include <query_template.h>
+#include <calendar.h>
+#include <spec_parser.h>
+#include <charconv>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace spl;
+
+static void fail(const std::string &placeholder, const char *reason) {
+    SpecParser::fail("query placeholder", placeholder, reason);
+}
+
+static std::shared_ptr<const std::vector<std::string>> loadChoices(
+    const std::string &path,
+    const std::string &placeholder
+) {
+    std::ifstream in(path);
+    if (! in) fail(placeholder, "cannot open the choice file");
+
+    auto choices = std::make_shared<std::vector<std::string>>();
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (! line.empty() && line.back() == '\r') line.pop_back();
+        if (! line.empty()) choices->push_back(std::move(line));
+    }
+
+    if (choices->empty()) fail(placeholder, "the choice file has no lines");
+
+    return choices;
+}
+
+QueryTemplate::QueryTemplate(const std::string &text, const std::string &directory, ChoiceFiles &files)
+:   text(text)
+{
+    size_t literal = 0;
+    size_t p = 0;
+
+    while ((p = text.find('{', p)) != std::string::npos) {
+        size_t close = text.find('}', p);
+        if (close == std::string::npos) break;
+
+        std::string placeholder = text.substr(p, close + 1 - p);
+        auto parts = SpecParser::split(text.substr(p + 1, close - p - 1));
+        const auto &name = parts[0];
+
+        Generator g;
+        g.literalBegin = literal;
+        g.literalEnd = p;
+
+        if (name == "uniform") {
+            if (parts.size() != 3) fail(placeholder, "expected {uniform:A:B}");
+
+            int64_t low, high;
+            if (SpecParser::parseInteger(parts[1], low) && SpecParser::parseInteger(parts[2], high)) {
+                if (low > high) fail(placeholder, "the bounds are reversed");
+
+                g.kind = Generator::Kind::INTEGER;
+                g.low = low;
+                g.span = (uint64_t) high - (uint64_t) low + 1;
+            }
+            else {
+                double realLow, realHigh;
+                if (! SpecParser::parseReal(parts[1], realLow) || ! SpecParser::parseReal(parts[2], realHigh)) {
+                    fail(placeholder, "the bounds are not numbers");
+                }
+                if (realLow > realHigh) fail(placeholder, "the bounds are reversed");
+
+                g.kind = Generator::Kind::REAL;
+                g.realLow = realLow;
+                g.realSpan = realHigh - realLow;
+            }
+        }
+        else if (name == "zipf") {
+            double s;
+            int64_t n;
+            if (parts.size() != 3 || ! SpecParser::parseReal(parts[1], s) || ! SpecParser::parseInteger(parts[2], n)) {
+                fail(placeholder, "expected {zipf:S:N}");
+            }
+            if (s <= 0 || n < 1) fail(placeholder, "S and N must be positive");
+
+            g.kind = Generator::Kind::ZIPF;
+            g.zipf = std::make_shared<ZipfDistribution>(s, n);
+        }
+        else if (name == "choice") {
+            if (parts.size() < 2) fail(placeholder, "expected {choice:FILE}");
+
+            // the path may itself contain colons
+            std::string path = text.substr(p + 1 + name.size() + 1, close - p - name.size() - 2);
+            if (path[0] != '/' && ! directory.empty()) path = directory + "/" + path;
+
+            auto &choices = files[path];
+            if (! choices) choices = loadChoices(path, placeholder);
+
+            g.kind = Generator::Kind::CHOICE;
+            g.choices = choices;
+        }
+        else if (name == "date_range") {
+            int64_t low, high;
+            if (parts.size() != 3 || ! SpecParser::parseDay(parts[1], low) || ! SpecParser::parseDay(parts[2], high)) {
+                fail(placeholder, "expected {date_range:YYYY-MM-DD:YYYY-MM-DD}");
+            }
+            if (low > high) fail(placeholder, "the bounds are reversed");
+
+            g.kind = Generator::Kind::DATE;
+            g.low = low;
+            g.span = high - low + 1;
+        }
+        else {
+            // not a placeholder
+            ++p;
+            continue;
+        }
+
+        _generators.push_back(std::move(g));
+        literal = p = close + 1;
+    }
+
+    _tail = literal;
+}
+
+const std::string & QueryTemplate::render(Random &random, std::string &buffer) const {
+    if (_generators.empty()) return text;
+
+    buffer.clear();
+
+    char value[32];
+
+    for (const auto &g : _generators) {
+        buffer.append(text, g.literalBegin, g.literalEnd - g.literalBegin);
+
+        char *end = value;
+
+        switch (g.kind) {
+        case Generator::Kind::INTEGER:
+            end = std::to_chars(value, value + sizeof(value), (int64_t) (g.low + random.below(g.span))).ptr;
+            break;
+
+        case Generator::Kind::REAL:
+            end = std::to_chars(value, value + sizeof(value), g.realLow + random.uniform() * g.realSpan).ptr;
+            break;
+
+        case Generator::Kind::ZIPF:
+            end = std::to_chars(value, value + sizeof(value), (*g.zipf)(random)).ptr;
+            break;
+
+        case Generator::Kind::CHOICE:
+            buffer.append((*g.choices)[random.below(g.choices->size())]);
+            break;
+
+        case Generator::Kind::DATE: {
+            int y;
+            unsigned m, d;
+            Calendar::civilFromDays(g.low + (int64_t) random.below(g.span), y, m, d);
+
+            // snprintf would take longer than everything else together
+            end = std::to_chars(value, value + sizeof(value), y).ptr;
+            *end++ = '-';
+            *end++ = '0' + m / 10;
+            *end++ = '0' + m % 10;
+            *end++ = '-';
+            *end++ = '0' + d / 10;
+            *end++ = '0' + d % 10;
+            break;
+        }
+        }
+
+        buffer.append(value, end);
+    }
+
+    buffer.append(text, _tail, std::string::npos);
+
+    return buffer;
+}
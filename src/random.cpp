@@ -0,0 +1,53 @@
+#include <random.h>
+#include <math.h>
+
+// log(1 + x) / x, accurate near 0
+static double helper1(double x) {
+    if (fabs(x) > 1e-8) return log1p(x) / x;
+    return 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+// (exp(x) - 1) / x, accurate near 0
+static double helper2(double x) {
+    if (fabs(x) > 1e-8) return expm1(x) / x;
+    return 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+}
+
+ZipfDistribution::ZipfDistribution(double s, uint64_t n)
+:   _s(s),
+    _n(n)
+{
+    _hIntegralX1 = _hIntegral(1.5) - 1;
+    _hIntegralN = _hIntegral(n + 0.5);
+    _threshold = 2 - _hIntegralInverse(_hIntegral(2.5) - _h(2));
+}
+
+double ZipfDistribution::_h(double x) const {
+    return exp(-_s * log(x));
+}
+
+double ZipfDistribution::_hIntegral(double x) const {
+    double logX = log(x);
+    return helper2((1 - _s) * logX) * logX;
+}
+
+double ZipfDistribution::_hIntegralInverse(double x) const {
+    double t = x * (1 - _s);
+    if (t < -1) t = -1;
+    return exp(helper1(t) * x);
+}
+
+uint64_t ZipfDistribution::operator()(Random &random) const {
+    for (;;) {
+        double u = _hIntegralN + random.uniform() * (_hIntegralX1 - _hIntegralN);
+        double x = _hIntegralInverse(u);
+
+        double k = floor(x + 0.5);
+        if (k < 1) k = 1;
+        else if (k > _n) k = _n;
+
+        if (k - x <= _threshold || u >= _hIntegral(k + 0.5) - _h(k)) {
+            return (uint64_t) k;
+        }
+    }
+}
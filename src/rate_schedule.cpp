@@ -0,0 +1,42 @@
+#include <rate_schedule.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// sleeps end this long before a slot is due and the rest is spun, since
+// waking from a sleep can overshoot by tens of microseconds
+#define SPIN_TIME std::chrono::microseconds(100)
+
+bool RateSchedule::next(size_t &slot, Clock::time_point &intended) {
+    slot = _next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= _slots) return false;
+
+    intended = _due(slot);
+    if (intended >= _end) return false;
+
+    auto now = Clock::now();
+    if (intended - now > SPIN_TIME) {
+        std::this_thread::sleep_until(intended - SPIN_TIME);
+    }
+    while ((now = Clock::now()) < intended);
+
+    if (now >= _end) return false;
+
+    if (now - intended > LATE_THRESHOLD) {
+        _late.fetch_add(1, std::memory_order_relaxed);
+    }
+    _issued.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+size_t RateSchedule::dropped() const {
+    size_t due = _slots;
+
+    if (_end != Clock::time_point::max()) {
+        double seconds = std::chrono::duration<double>(_end - _start).count();
+        due = std::min(due, (size_t) std::ceil(seconds * _rate));
+    }
+
+    return due > issued() ? due - issued() : 0;
+}
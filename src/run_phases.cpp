@@ -0,0 +1,71 @@
+#include <run_phases.h>
+#include <algorithm>
+
+static RunPhases::Clock::duration toDuration(double seconds) {
+    return std::chrono::duration_cast<RunPhases::Clock::duration>(
+        std::chrono::duration<double>(seconds)
+    );
+}
+
+RunPhases::RunPhases(double rampUp, double warmUp, double duration)
+:   _rampUp(toDuration(rampUp)),
+    _warmUp(toDuration(warmUp)),
+    _measured(toDuration(duration)),
+    _bounded(duration > 0)
+{ }
+
+const char * RunPhases::name(Phase phase) {
+    switch (phase) {
+    case Phase::RAMP_UP:
+        return "ramp-up";
+
+    case Phase::WARM_UP:
+        return "warm-up";
+
+    case Phase::MEASURED:
+        return "measured";
+    }
+
+    return "";
+}
+
+RunPhases::Clock::time_point RunPhases::begin(Phase phase) const {
+    switch (phase) {
+    case Phase::RAMP_UP:
+        return _start;
+
+    case Phase::WARM_UP:
+        return _start + _rampUp;
+
+    case Phase::MEASURED:
+        return _start + _rampUp + _warmUp;
+    }
+
+    return _start;
+}
+
+RunPhases::Clock::time_point RunPhases::end() const {
+    if (! _bounded) return Clock::time_point::max();
+    return begin(Phase::MEASURED) + _measured;
+}
+
+RunPhases::Phase RunPhases::at(Clock::time_point t) const {
+    if (t >= begin(Phase::MEASURED)) return Phase::MEASURED;
+    if (t >= begin(Phase::WARM_UP)) return Phase::WARM_UP;
+    return Phase::RAMP_UP;
+}
+
+RunPhases::Clock::time_point RunPhases::activation(size_t i, size_t n) const {
+    // connections beyond the n that are ramped up start with the warm-up
+    if (i >= n) return begin(Phase::WARM_UP);
+    return _start + _rampUp * i / n;
+}
+
+double RunPhases::seconds(Phase phase, Clock::time_point finish) const {
+    auto from = begin(phase);
+    auto to = phase == Phase::MEASURED ? end() : begin((Phase) ((int) phase + 1));
+    to = std::min(to, finish);
+
+    if (to <= from) return 0;
+    return std::chrono::duration<double>(to - from).count();
+}
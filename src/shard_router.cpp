@@ -0,0 +1,230 @@
+#include <shard_router.h>
+#include <spec_parser.h>
+#include <algorithm>
+#include <sstream>
+#include <type_traits>
+#include <stdlib.h>
+
+using namespace spl;
+
+static void fail(const char *spec, const char *reason) {
+    SpecParser::fail("shard", spec, reason);
+}
+
+ShardTarget ShardTarget::parse(const char *spec) {
+    ShardTarget target;
+    std::string s = spec;
+
+    auto slash = s.find('/');
+    if (slash != std::string::npos) {
+        target.host = s.substr(0, slash);
+        target.table = s.substr(slash + 1);
+
+        auto colon = target.host.find(':');
+        if (colon != std::string::npos) {
+            int64_t port;
+            if (! SpecParser::parseInteger(target.host.substr(colon + 1), port) || port <= 0 || port > 65535) {
+                fail(spec, "bad port");
+            }
+            target.port = port;
+            target.host.resize(colon);
+        }
+
+        if (target.host.empty()) fail(spec, "no host before '/'");
+    }
+    else {
+        target.table = s;
+    }
+
+    if (target.table.empty()) fail(spec, "no table");
+
+    return target;
+}
+
+std::string ShardTarget::name() const {
+    std::stringstream s;
+    if (! host.empty()) {
+        s << host;
+        if (port != 0) s << ':' << port;
+        s << '/';
+    }
+    s << table;
+    return s.str();
+}
+
+// the finalizer of splitmix64, which spreads keys that differ in a few low
+// bits, like sequential ids, over the whole range
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+// maps a hash to [0, n) with a multiply instead of a division
+static inline uint32_t reduce(uint64_t hash, size_t n) {
+    return ((__uint128_t) hash * n) >> 64;
+}
+
+static bool isInteger(DataType type) {
+    switch (type) {
+    case DataType::UINT8:
+    case DataType::UINT16:
+    case DataType::UINT32:
+    case DataType::UINT64:
+    case DataType::INT8:
+    case DataType::INT16:
+    case DataType::INT32:
+    case DataType::INT64:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+ShardRouter::ShardRouter(const char *spec, const std::vector<CSVField> &fields, size_t shards)
+:   _fields(fields),
+    _shards(shards)
+{
+    if (shards == 0) SpecParser::fail("shard key", spec, "no shards");
+
+    auto parts = SpecParser::split(spec);
+
+    int64_t column;
+    if (parts.size() < 2 || ! SpecParser::parseInteger(parts[0], column)) {
+        SpecParser::fail("shard key", spec, "expected COLUMN:hash or COLUMN:range:BOUNDS");
+    }
+    if (column < 1 || (size_t) column > fields.size()) SpecParser::fail("shard key", spec, "no such column");
+    _column = column - 1;
+
+    auto type = fields[_column].type;
+
+    if (parts[1] == "hash" && parts.size() == 2) {
+        if (! isInteger(type) && type != DataType::STRING) {
+            SpecParser::fail("shard key", spec, "hashing needs an integer or string column");
+        }
+        _method = Method::HASH;
+    }
+    else if (parts[1] == "range") {
+        if (! isInteger(type)) SpecParser::fail("shard key", spec, "ranges need an integer column");
+
+        for (size_t i = 2; i < parts.size(); ++i) {
+            int64_t bound;
+            if (! SpecParser::parseInteger(parts[i], bound)) SpecParser::fail("shard key", spec, "bad bound");
+            if (! _bounds.empty() && bound <= _bounds.back()) SpecParser::fail("shard key", spec, "bounds must increase");
+            _bounds.push_back(bound);
+        }
+
+        if (_bounds.size() != shards - 1) SpecParser::fail("shard key", spec, "a range needs one bound less than there are shards");
+        _method = Method::RANGE;
+    }
+    else {
+        SpecParser::fail("shard key", spec, "expected COLUMN:hash or COLUMN:range:BOUNDS");
+    }
+}
+
+template <typename T>
+static inline bool atLeast(T value, int64_t bound) {
+    if constexpr (std::is_unsigned_v<T>) {
+        return bound < 0 || (uint64_t) value >= (uint64_t) bound;
+    }
+    else {
+        return (int64_t) value >= bound;
+    }
+}
+
+template <typename T>
+void ShardRouter::_assign(const T *values, size_t n, uint32_t *shards) const {
+    if (_method == Method::HASH) {
+        // signed values are widened with their sign, so a key hashes the
+        // same whatever the width of its column
+        for (size_t i = 0; i < n; ++i) shards[i] = reduce(mix((uint64_t) values[i]), _shards);
+        return;
+    }
+
+    // a row's shard is the number of bounds at or below its key, counted a
+    // bound at a time over the whole column, without branches
+    std::fill(shards, shards + n, 0);
+    for (int64_t bound : _bounds) {
+        for (size_t i = 0; i < n; ++i) shards[i] += atLeast(values[i], bound);
+    }
+}
+
+void ShardRouter::_assignStrings(const ColumnChunk &column, uint32_t *shards) const {
+    // FNV-1a over the bytes of the value
+    for (size_t i = 0; i < column.size; ++i) {
+        const char *p = column.stringAt(i);
+        size_t len = column.stringLength(i);
+
+        uint64_t h = 0xcbf29ce484222325;
+        for (size_t k = 0; k < len; ++k) {
+            h ^= (unsigned char) p[k];
+            h *= 0x100000001b3;
+        }
+
+        shards[i] = reduce(mix(h), _shards);
+    }
+}
+
+void ShardRouter::partition(const ColumnarTableChunk *chunk, ShardPartition &partition) const {
+    size_t n = chunk->size();
+    const auto &key = chunk->columns[_column];
+
+    partition.shards.resize(n);
+    auto shards = partition.shards.data();
+
+    switch (key.type) {
+    case DataType::UINT8:
+        _assign(static_cast<const uint8_t *>(key.data), n, shards);
+        break;
+
+    case DataType::UINT16:
+        _assign(static_cast<const uint16_t *>(key.data), n, shards);
+        break;
+
+    case DataType::UINT32:
+        _assign(static_cast<const uint32_t *>(key.data), n, shards);
+        break;
+
+    case DataType::UINT64:
+        _assign(static_cast<const uint64_t *>(key.data), n, shards);
+        break;
+
+    case DataType::INT8:
+        _assign(static_cast<const int8_t *>(key.data), n, shards);
+        break;
+
+    case DataType::INT16:
+        _assign(static_cast<const int16_t *>(key.data), n, shards);
+        break;
+
+    case DataType::INT32:
+        _assign(static_cast<const int32_t *>(key.data), n, shards);
+        break;
+
+    case DataType::INT64:
+        _assign(static_cast<const int64_t *>(key.data), n, shards);
+        break;
+
+    case DataType::STRING:
+        _assignStrings(key, shards);
+        break;
+
+    default:
+        // ruled out by the constructor
+        std::fill(shards, shards + n, 0);
+        break;
+    }
+
+    // a counting sort of the row numbers by shard
+    partition.begins.assign(_shards + 1, 0);
+    for (size_t i = 0; i < n; ++i) ++partition.begins[shards[i] + 1];
+    for (size_t s = 0; s < _shards; ++s) partition.begins[s + 1] += partition.begins[s];
+
+    partition.next.assign(partition.begins.begin(), partition.begins.end() - 1);
+    partition.rows.resize(n);
+    for (size_t i = 0; i < n; ++i) partition.rows[partition.next[shards[i]]++] = i;
+}
@@ -0,0 +1,103 @@
+#include <workload.h>
+#include <exception.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <errno.h>
+#include <string.h>
+
+using namespace spl;
+
+static void fail(const char *path, size_t line, const std::string &reason) {
+    std::stringstream msg;
+    msg << path << ":" << line << ": " << reason;
+    throw DynamicMessageError(msg.str().c_str());
+}
+
+static std::string trim(const std::string &s) {
+    const char *space = " \t\r\n";
+    size_t begin = s.find_first_not_of(space);
+    if (begin == std::string::npos) return "";
+    return s.substr(begin, s.find_last_not_of(space) + 1 - begin);
+}
+
+Workload::Workload(const char *path, QueryTemplate::ChoiceFiles &files) {
+    std::ifstream in(path);
+    if (! in) fail(path, 0, strerror(errno));
+
+    std::string directory = path;
+    auto slash = directory.find_last_of('/');
+    directory.resize(slash == std::string::npos ? 0 : slash);
+
+    // the statement being read, which may span several lines
+    std::string statement;
+    size_t lineNumber = 0;
+
+    auto addStatement = [&] {
+        auto text = trim(statement);
+        statement.clear();
+        if (text.empty()) return;
+
+        if (_transactions.empty()) fail(path, lineNumber, "statement before the first @transaction");
+
+        try {
+            _transactions.back().statements.emplace_back(text, directory, files);
+        }
+        catch (const std::exception &e) {
+            fail(path, lineNumber, e.what());
+        }
+    };
+
+    std::string line;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+
+        if (line.compare(0, 2, "--") == 0) continue;
+
+        if (trim(statement).empty() && line.compare(0, 12, "@transaction") == 0) {
+            std::istringstream fields(line.substr(12));
+            Transaction t;
+            int64_t weight;
+            std::string rest;
+            if (! (fields >> t.name >> weight) || (fields >> rest) || weight < 0) {
+                fail(path, lineNumber, "expected '@transaction NAME WEIGHT'");
+            }
+            t.weight = weight;
+
+            for (const auto &other : _transactions) {
+                if (other.name == t.name) fail(path, lineNumber, "transaction '" + t.name + "' is defined twice");
+            }
+
+            statement.clear();
+            _transactions.push_back(std::move(t));
+            continue;
+        }
+
+        // a semicolon ends a statement, and another may follow on the line
+        size_t begin = 0;
+        for (size_t semicolon; (semicolon = line.find(';', begin)) != std::string::npos; begin = semicolon + 1) {
+            statement.append(line, begin, semicolon - begin);
+            addStatement();
+        }
+        statement.append(line, begin, std::string::npos);
+        statement += '\n';
+    }
+
+    if (! trim(statement).empty()) fail(path, lineNumber, "statement without a closing semicolon");
+    if (_transactions.empty()) fail(path, lineNumber, "no transactions");
+
+    uint64_t total = 0;
+    for (const auto &t : _transactions) {
+        if (t.statements.empty()) fail(path, lineNumber, "transaction '" + t.name + "' has no statements");
+
+        total += t.weight;
+        _cumulative.push_back(total);
+    }
+
+    if (total == 0) fail(path, lineNumber, "every transaction has weight 0");
+}
+
+size_t Workload::pick(Random &random) const {
+    uint64_t r = random.below(_cumulative.back());
+    return std::upper_bound(_cumulative.begin(), _cumulative.end(), r) - _cumulative.begin();
+}